@@ -1,4 +1,4 @@
-QT       += core gui multimedia
+QT       += core gui multimedia concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -16,16 +16,30 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    audioengine.cpp \
+    audioimporter.cpp \
+    loudnessmeter.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    previewfile.cpp \
+    resampler.cpp \
+    wavfile.cpp
 
 HEADERS += \
-    mainwindow.h
+    audioengine.h \
+    audioimporter.h \
+    loudnessmeter.h \
+    mainwindow.h \
+    previewfile.h \
+    resampler.h \
+    wavfile.h
 
 FORMS += \
     mainwindow.ui
 
 unix: LIBS += -lSoundTouch
+# Lets the compiler vectorize the sample loops of the audio path
+unix: QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
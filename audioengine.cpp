@@ -0,0 +1,224 @@
+#include "audioengine.h"
+#include "wavfile.h"
+
+#include <soundtouch/SoundTouch.h>
+
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// The samples are given to SoundTouch without conversion
+static_assert(std::is_same<soundtouch::SAMPLETYPE, float>::value,
+              "SoundTouch must be built with float samples");
+
+/**
+ * Multiply count samples by gain
+ * The loop does not depend on the channels so it is vectorized by the compiler
+ */
+static void apply_gain(float *samples, qint64 count, float gain)
+{
+    for (qint64 i = 0; i < count; i++){
+        samples[i] *= gain;
+    }
+}
+
+//Audio engine constructor
+AudioEngine::AudioEngine()
+{
+}
+
+/**
+ * Generates output from the WAV file input with the tempo change
+ * (in percent, 0 keeps the tempo) and the pitch change (in semitones)
+ * The output is converted to outputRate (0 keeps the rate of the input)
+ * with the given quality.
+ * Returns false if the file cannot be read or written (see errorString)
+ */
+bool AudioEngine::render(const QString &input, const QString &output, int tempo, int pitch,
+                         quint32 outputRate, Resampler::Quality quality)
+{
+    if (cancelled){
+        error = "Render cancelled";
+        return false;
+    }
+    WavReader reader(input);
+    if (!reader.open()){
+        error = reader.errorString();
+        return false;
+    }
+    const WavFormat &in_format = reader.format();
+    const int channels = in_format.channels;
+    input_loudness = LoudnessInfo();
+#ifdef SOUNDTOUCH_MAX_CHANNELS
+    if (channels > SOUNDTOUCH_MAX_CHANNELS){
+        error = "Too many channels : " + QString::number(channels);
+        return false;
+    }
+#endif
+
+    // The output keeps the channels of the input, in float
+    const quint32 out_rate = outputRate ? outputRate : in_format.sampleRate;
+    WavFormat out_format;
+    out_format.channels = in_format.channels;
+    out_format.sampleRate = out_rate;
+    out_format.channelMask = in_format.channelMask;
+    out_format.bitsPerSample = 32;
+    out_format.isFloat = true;
+    WavWriter writer(output, out_format);
+    if (!writer.open()){
+        error = writer.errorString();
+        return false;
+    }
+
+    // For the preview, the rate conversion is done by the rate transposer of
+    // SoundTouch in the same pass as the pitch change. Otherwise (or without
+    // effect) the dedicated resampler is put after the effects.
+    const bool effects = (tempo != 0 || pitch != 0);
+    const bool convert = (out_rate != in_format.sampleRate);
+    const bool fused = convert && effects && quality == Resampler::Preview;
+    std::unique_ptr<Resampler> resampler;
+    if (convert && !fused){
+        resampler.reset(new Resampler(channels, in_format.sampleRate, out_rate, quality));
+    }
+
+    std::vector<float> in_buffer((size_t)BlockFrames * channels);
+    std::vector<float> out_buffer((size_t)BlockFrames * channels);
+    std::vector<float> resampled;
+    bool ok = true;
+
+    // The loudness is measured on the input, in the same pass as the reading
+    LoudnessMeter meter(channels, in_format.sampleRate,
+                        in_format.channelMask ? in_format.channelMask : WavFormat::defaultChannelMask(channels));
+    auto read = [&](){
+        // A cancelled render stops as if the file was over
+        if (cancelled){
+            return (qint64)0;
+        }
+        qint64 frames = reader.read(in_buffer.data(), BlockFrames);
+        meter.process(in_buffer.data(), frames);
+        return frames;
+    };
+
+    // Last stages of the pipeline : rate conversion if needed, gain, then the file
+    auto write = [&](float *samples, qint64 frames){
+        if (resampler){
+            resampled.clear();
+            frames = resampler->process(samples, frames, resampled);
+            samples = resampled.data();
+        }
+        if (output_gain != 1.0f){
+            apply_gain(samples, frames * channels, output_gain);
+        }
+        ok = ok && writer.write(samples, frames);
+    };
+    auto finish = [&](){
+        if (resampler){
+            resampled.clear();
+            qint64 frames = resampler->flush(resampled);
+            if (output_gain != 1.0f){
+                apply_gain(resampled.data(), frames * channels, output_gain);
+            }
+            ok = ok && writer.write(resampled.data(), frames);
+        }
+        input_loudness = meter.result();
+        ok = ok && writer.close();
+        if (!ok){
+            error = writer.errorString();
+            return false;
+        }
+        if (cancelled){
+            error = "Render cancelled";
+            input_loudness = LoudnessInfo();
+            return false;
+        }
+        // A read error stops the reading like the end of the file
+        if (!reader.atEnd()){
+            error = reader.errorString();
+            input_loudness = LoudnessInfo();
+            return false;
+        }
+        return true;
+    };
+    qint64 frames;
+
+    // Without effect, the samples are only converted to float
+    if (!effects){
+        while (ok && (frames = read()) > 0){
+            write(in_buffer.data(), frames);
+        }
+        return finish();
+    }
+
+    soundtouch::SoundTouch stretch;
+    stretch.setSampleRate(in_format.sampleRate);
+    stretch.setChannels(channels);
+    stretch.setTempoChange(tempo);
+    stretch.setPitchSemiTones(pitch);
+    if (fused){
+        // Played at out_rate, audio transposed by in_rate / out_rate keeps its pitch and duration
+        stretch.setRate((double)in_format.sampleRate / out_rate);
+    }
+    // The cost of the full search grows with the square of the rate (not with
+    // the channels), so the quick search is only used above 48 kHz
+    if (in_format.sampleRate > 48000){
+        stretch.setSetting(SETTING_USE_QUICKSEEK, 1);
+    }
+
+    auto drain = [&](){
+        uint received;
+        while (ok && (received = stretch.receiveSamples(out_buffer.data(), BlockFrames)) > 0){
+            write(out_buffer.data(), received);
+        }
+    };
+    while (ok && (frames = read()) > 0){
+        stretch.putSamples(in_buffer.data(), (uint)frames);
+        drain();
+    }
+    stretch.flush();
+    drain();
+    return finish();
+}
+
+/**
+ * Returns the position in the audio generated with the tempo change toTempo
+ * which corresponds to position in the audio generated with fromTempo
+ * (tempo changes in percent, the position can be in any unit)
+ */
+double AudioEngine::mapPosition(double position, int fromTempo, int toTempo)
+{
+    // The durations are inversely proportional to the tempos
+    return position * (fromTempo + 100) / (toTempo + 100);
+}
+
+/**
+ * Set the linear gain applied to the output of the next renders
+ */
+void AudioEngine::setGain(float gain)
+{
+    output_gain = gain;
+}
+
+/**
+ * Returns the loudness of the input of the last render
+ */
+LoudnessInfo AudioEngine::loudness() const
+{
+    return input_loudness;
+}
+
+/**
+ * Returns the reason of the last failure
+ */
+QString AudioEngine::errorString() const
+{
+    return error;
+}
+
+/**
+ * Stop the render running in another thread at its next block, it then
+ * returns false. The next renders of this engine are cancelled too
+ */
+void AudioEngine::cancel()
+{
+    cancelled = true;
+}
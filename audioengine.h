@@ -0,0 +1,84 @@
+#ifndef AUDIOENGINE_H
+#define AUDIOENGINE_H
+
+#include <QString>
+
+#include <atomic>
+
+#include "loudnessmeter.h"
+#include "resampler.h"
+
+/**
+ * Applies the tempo and pitch effects to a WAV file in process
+ * with the SoundTouch library.
+ *
+ * The file is streamed block by block : the samples are read as floats,
+ * processed and written as 32 bit float WAV, so any sample size, number
+ * of channels or sample rate is kept without being requantized.
+ * The output can also be converted to another sample rate (the rate of
+ * the audio device) so that the playback does not depend on the backend.
+ * The loudness of the input is measured while it is read, and a gain can
+ * be applied to the output in the last stage.
+ */
+class AudioEngine
+{
+public:
+    //Number of frames read and processed at once
+    static const int BlockFrames = 4096;
+
+    //Audio engine constructor
+    AudioEngine();
+
+    /**
+     * Generates output from the WAV file input with the tempo change
+     * (in percent, 0 keeps the tempo) and the pitch change (in semitones)
+     * The output is converted to outputRate (0 keeps the rate of the input)
+     * with the given quality.
+     * Returns false if the file cannot be read or written (see errorString)
+     */
+    bool render(const QString &input, const QString &output, int tempo, int pitch,
+                quint32 outputRate = 0, Resampler::Quality quality = Resampler::Export);
+
+    /**
+     * Returns the position in the audio generated with the tempo change toTempo
+     * which corresponds to position in the audio generated with fromTempo
+     * (tempo changes in percent, the position can be in any unit)
+     */
+    static double mapPosition(double position, int fromTempo, int toTempo);
+
+    /**
+     * Set the linear gain applied to the output of the next renders
+     */
+    void setGain(float gain);
+
+    /**
+     * Returns the loudness of the input of the last render
+     */
+    LoudnessInfo loudness() const;
+
+    /**
+     * Returns the reason of the last failure
+     */
+    QString errorString() const;
+
+    /**
+     * Stop the render running in another thread at its next block, it then
+     * returns false. The next renders of this engine are cancelled too
+     */
+    void cancel();
+
+private:
+    //Gain applied to the output
+    float output_gain = 1.0f;
+
+    //Loudness of the input of the last render
+    LoudnessInfo input_loudness;
+
+    //Reason of the last failure
+    QString error;
+
+    //Bool defining if the renders are cancelled, set from another thread
+    std::atomic<bool> cancelled{false};
+};
+
+#endif // AUDIOENGINE_H
@@ -0,0 +1,233 @@
+#include "audioimporter.h"
+#include "wavfile.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+//Audio importer constructor
+AudioImporter::AudioImporter(QObject *parent)
+    : QObject(parent)
+{
+    qRegisterMetaType<ImportResult>("ImportResult");
+    qRegisterMetaType<QList<ImportResult>>("QList<ImportResult>");
+}
+
+//Audio importer destructor, waits for the running imports
+AudioImporter::~AudioImporter()
+{
+    // The workers must not outlive the watchers (children of the importer)
+    foreach (QFutureWatcherBase *watcher, findChildren<QFutureWatcherBase*>()){
+        watcher->disconnect(this);
+        watcher->cancel();
+        watcher->waitForFinished();
+    }
+}
+
+/**
+ * Start importing a list of paths, each path being a file or a directory.
+ * Can be called again while an import is running, the new paths are
+ * imported in parallel and counted in the same progress.
+ */
+void AudioImporter::import(const QStringList &paths)
+{
+    if (paths.isEmpty()){
+        return;
+    }
+    if (running_jobs == 0){
+        done_files = 0;
+        total_files = 0;
+    }
+    running_jobs++;
+
+    // Walking big directories is slow too, so it is also done in the thread pool
+    QFutureWatcher<QStringList> *watcher = new QFutureWatcher<QStringList>(this);
+    connect(watcher, &QFutureWatcher<QStringList>::finished, this, [this, watcher](){
+        if (!watcher->isCanceled()){
+            probe_files(watcher->result());
+        }
+        job_finished();
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run(&AudioImporter::expand, paths));
+}
+
+/**
+ * Cancel every running import, the batches already sent are kept
+ */
+void AudioImporter::cancel()
+{
+    foreach (QFutureWatcherBase *watcher, findChildren<QFutureWatcherBase*>()){
+        watcher->cancel();
+    }
+}
+
+/**
+ * Returns true if an import is running
+ */
+bool AudioImporter::isRunning() const
+{
+    return running_jobs > 0;
+}
+
+/**
+ * Returns the suffixes of the supported audio files
+ */
+QStringList AudioImporter::supportedSuffixes()
+{
+    return QStringList() << "wav" << "mp3" << "ogg";
+}
+
+/**
+ * Returns the list of files to probe : the files in input are kept
+ * and the directories are replaced by the supported files they contain
+ * (recursively)
+ */
+QStringList AudioImporter::expand(const QStringList &paths)
+{
+    QStringList filters;
+    foreach (QString suffix, supportedSuffixes()){
+        filters << "*." + suffix;
+    }
+
+    QStringList files;
+    foreach (QString path, paths){
+        QFileInfo info(path);
+        if (!info.isDir()){
+            files << path;
+            continue;
+        }
+        // Symbolic links are not followed to avoid walking a loop forever.
+        // The unreadable files are kept, the probe flags them with the reason
+        QStringList found;
+        QDirIterator it(path, filters, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()){
+            found << it.next();
+        }
+        found.sort();
+        files << found;
+    }
+    return files;
+}
+
+/**
+ * Returns true if the bytes are the header of an MPEG audio frame
+ */
+static bool is_mpeg_frame(const QByteArray &bytes)
+{
+    return bytes.size() >= 2
+            && (unsigned char)bytes.at(0) == 0xFF
+            && ((unsigned char)bytes.at(1) & 0xE0) == 0xE0;
+}
+
+/**
+ * Read the header of a file and check that it is a supported audio file.
+ * Only the first bytes of the file are read.
+ */
+ImportResult AudioImporter::probe(const QString &path)
+{
+    ImportResult result;
+    result.path = path;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)){
+        result.error = file.errorString();
+        return result;
+    }
+    QByteArray header = file.read(12);
+    if (header.isEmpty()){
+        result.error = "Empty file";
+        return result;
+    }
+
+    if (header.startsWith("RIFF") && header.mid(8, 4) == "WAVE"){
+        // Every WAV file is given to the player, the WAV reader only tells
+        // if the engine can apply the effects (it only reads the chunk headers)
+        WavReader reader(path);
+        result.format = "wav";
+        result.valid = true;
+        result.effects = reader.open();
+        if (!result.effects){
+            result.error = reader.errorString();
+        }
+        return result;
+    }
+    else if (header.startsWith("OggS")){
+        result.format = "ogg";
+    }
+    else if (header.startsWith("ID3") && header.size() >= 10){
+        // The ID3v2 tag size is stored in 4 bytes of 7 bits each
+        const uchar *data = reinterpret_cast<const uchar*>(header.constData());
+        qint64 tag_size = 10 + ((data[6] & 0x7F) << 21) + ((data[7] & 0x7F) << 14)
+                + ((data[8] & 0x7F) << 7) + (data[9] & 0x7F);
+        file.seek(tag_size);
+        if (is_mpeg_frame(file.read(2))){
+            result.format = "mp3";
+        }
+        else{
+            result.error = "No MPEG audio after the ID3 tag";
+        }
+    }
+    else if (is_mpeg_frame(header)){
+        result.format = "mp3";
+    }
+    else{
+        result.error = "Unknown audio format";
+    }
+
+    result.valid = result.error.isEmpty();
+    return result;
+}
+
+/**
+ * Probe the expanded files of a job in the thread pool
+ */
+void AudioImporter::probe_files(const QStringList &files)
+{
+    if (files.isEmpty()){
+        return;
+    }
+    running_jobs++;
+    total_files += files.size();
+    emit progress(done_files, total_files);
+
+    QFutureWatcher<ImportResult> *watcher = new QFutureWatcher<ImportResult>(this);
+    // The results are ready in the order the probes finish, they are held
+    // until every file before them is probed so that the sorted order is kept
+    int next = 0;
+    connect(watcher, &QFutureWatcher<ImportResult>::resultsReadyAt, this, [this, watcher, next](int begin, int end) mutable {
+        Q_UNUSED(begin);
+        Q_UNUSED(end);
+        QFuture<ImportResult> future = watcher->future();
+        QList<ImportResult> batch;
+        while (future.isResultReadyAt(next)){
+            batch << future.resultAt(next);
+            next++;
+        }
+        if (batch.isEmpty()){
+            return;
+        }
+        done_files += batch.size();
+        emit batchReady(batch);
+        emit progress(done_files, total_files);
+    });
+    connect(watcher, &QFutureWatcher<ImportResult>::finished, this, [this, watcher](){
+        job_finished();
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::mapped(files, &AudioImporter::probe));
+}
+
+/**
+ * Called when a job is done, sends finished if it was the last one
+ */
+void AudioImporter::job_finished()
+{
+    running_jobs--;
+    if (running_jobs == 0){
+        emit finished();
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef AUDIOIMPORTER_H
+#define AUDIOIMPORTER_H
+
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QMetaType>
+
+/**
+ * Result of probing one file during an import.
+ * A file is valid if its header matches one of the supported formats,
+ * otherwise error contains the reason why it was rejected.
+ * A valid WAV file whose encoding is not read by the audio engine
+ * (ADPCM, A-law, 12 bit PCM...) is still played, but without effects.
+ */
+struct ImportResult
+{
+    //Full path of the probed file
+    QString path;
+
+    //Format detected from the header ("wav", "mp3", "ogg"), empty if unknown
+    QString format;
+
+    //Bool defining if the file can be played or not
+    bool valid = false;
+
+    //Bool defining if the effects can be applied on the file or not
+    bool effects = false;
+
+    //Reason why the file was rejected or why the effects cannot be applied, empty otherwise
+    QString error;
+};
+Q_DECLARE_METATYPE(ImportResult)
+
+/**
+ * Imports audio files into the playlist without blocking the GUI thread.
+ *
+ * Directories are walked recursively and every file is probed in the
+ * global thread pool. The results are sent back to the GUI thread
+ * in batches with the signal batchReady.
+ */
+class AudioImporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    //Audio importer constructor
+    explicit AudioImporter(QObject *parent = nullptr);
+
+    //Audio importer destructor, waits for the running imports
+    ~AudioImporter();
+
+    /**
+     * Start importing a list of paths, each path being a file or a directory.
+     * Can be called again while an import is running, the new paths are
+     * imported in parallel and counted in the same progress.
+     */
+    void import(const QStringList &paths);
+
+    /**
+     * Cancel every running import, the batches already sent are kept
+     */
+    void cancel();
+
+    /**
+     * Returns true if an import is running
+     */
+    bool isRunning() const;
+
+    /**
+     * Returns the suffixes of the supported audio files
+     */
+    static QStringList supportedSuffixes();
+
+    /**
+     * Returns the list of files to probe : the files in input are kept
+     * and the directories are replaced by the supported files they contain
+     * (recursively)
+     */
+    static QStringList expand(const QStringList &paths);
+
+    /**
+     * Read the header of a file and check that it is a supported audio file.
+     * Only the first bytes of the file are read.
+     */
+    static ImportResult probe(const QString &path);
+
+signals:
+    /**
+     * Sent on the GUI thread each time a group of files has been probed
+     */
+    void batchReady(const QList<ImportResult> &batch);
+
+    /**
+     * Sent when the number of probed files changes
+     */
+    void progress(int done, int total);
+
+    /**
+     * Sent when every import is done (or cancelled)
+     */
+    void finished();
+
+private:
+    /**
+     * Probe the expanded files of a job in the thread pool
+     */
+    void probe_files(const QStringList &files);
+
+    /**
+     * Called when a job is done, sends finished if it was the last one
+     */
+    void job_finished();
+
+    //Number of running jobs (expanding or probing)
+    int running_jobs = 0;
+
+    //Number of files probed since the first running job started
+    int done_files = 0;
+
+    //Number of files to probe since the first running job started
+    int total_files = 0;
+};
+
+#endif // AUDIOIMPORTER_H
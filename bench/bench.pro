@@ -0,0 +1,18 @@
+QT       -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = soundchange_bench
+
+# Measures the throughput of the audio stages, run it in release mode
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    ../resampler.cpp
+
+HEADERS += \
+    ../resampler.h
+
+unix: QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize
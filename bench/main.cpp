@@ -0,0 +1,59 @@
+#include "resampler.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include <cmath>
+#include <vector>
+
+/**
+ * Measures how many times faster than realtime the resampler converts
+ * 10 seconds of noise, for the usual rate conversions and both qualities
+ */
+static void bench_resampler(QTextStream &out, int channels, quint32 input_rate, quint32 output_rate,
+                            Resampler::Quality quality)
+{
+    const int seconds = 10;
+    const qint64 frames = (qint64)input_rate * seconds;
+    std::vector<float> input((size_t)frames * channels);
+    quint32 seed = 1;
+    for (size_t i = 0; i < input.size(); i++){
+        seed = seed * 1664525u + 1013904223u;
+        input[i] = (float)(seed >> 8) / 8388608.0f - 1.0f;
+    }
+
+    Resampler resampler(channels, input_rate, output_rate, quality);
+    std::vector<float> output;
+    output.reserve((size_t)((double)frames * output_rate / input_rate + 1) * channels);
+    QElapsedTimer timer;
+    timer.start();
+    for (qint64 i = 0; i < frames; i += 4096){
+        qint64 block = qMin<qint64>(4096, frames - i);
+        resampler.process(&input[(size_t)i * channels], block, output);
+    }
+    resampler.flush(output);
+    double elapsed = qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9;
+
+    out << (quality == Resampler::Preview ? "preview" : "export ") << "  "
+        << channels << " ch  " << input_rate << " -> " << output_rate << " Hz  : "
+        << QString::number(seconds / elapsed, 'f', 1) << " x realtime, "
+        << QString::number(frames / elapsed / 1e6, 'f', 2) << " Mframes/s\n";
+    out.flush();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+
+    const quint32 rates[][2] = {{44100, 48000}, {48000, 44100}, {96000, 48000}, {44100, 96000}, {192000, 48000}};
+    for (int quality = Resampler::Preview; quality <= Resampler::Export; quality++){
+        for (int channels : {2, 8}){
+            for (const auto &rate : rates){
+                bench_resampler(out, channels, rate[0], rate[1], (Resampler::Quality)quality);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "loudnessmeter.h"
+
+#include <algorithm>
+#include <cmath>
+
+//Number of input frames used for one oversampled value of the true peak
+static const int PeakTaps = 12;
+
+/**
+ * Returns the linear gain bringing the track to target LUFS
+ * without making its true peak go above ceiling dBTP
+ * (1 if the track could not be measured)
+ */
+float LoudnessInfo::gain(double target, double ceiling) const
+{
+    if (!valid){
+        return 1.0f;
+    }
+    double db = std::min(target - integrated, ceiling - truePeak);
+    return (float)std::pow(10.0, db / 20.0);
+}
+
+//Loudness meter constructor, channelMask gives the speaker of each channel (0 if unknown)
+LoudnessMeter::LoudnessMeter(int channels, quint32 sampleRate, quint32 channelMask)
+    : nb_channels(channels)
+    , weights(channels, 1.0)
+    , states((size_t)channels * 4, 0.0)
+{
+    // The channels follow the bits of the mask : the LFE (0x8) is not counted
+    // and the surround channels (back 0x30, side 0x600) count 1.41 times
+    int ch = 0;
+    for (int bit = 0; bit < 32 && ch < channels; bit++){
+        quint32 speaker = 1u << bit;
+        if (!(channelMask & speaker)){
+            continue;
+        }
+        if (speaker == 0x8){
+            weights[ch] = 0.0;
+        }
+        else if (speaker & 0x630){
+            weights[ch] = 1.41;
+        }
+        ch++;
+    }
+
+    // K-weighting filters of BS.1770, computed for the rate of the track
+    const double fs = sampleRate;
+    double f0 = 1681.974450955533;
+    double G = 3.999843853973347;
+    double Q = 0.7071752369554196;
+    double K = std::tan(M_PI * f0 / fs);
+    double Vh = std::pow(10.0, G / 20.0);
+    double Vb = std::pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+    shelf[0] = (Vh + Vb * K / Q + K * K) / a0;
+    shelf[1] = 2.0 * (K * K - Vh) / a0;
+    shelf[2] = (Vh - Vb * K / Q + K * K) / a0;
+    shelf[3] = 2.0 * (K * K - 1.0) / a0;
+    shelf[4] = (1.0 - K / Q + K * K) / a0;
+
+    f0 = 38.13547087602444;
+    Q = 0.5003270373238773;
+    K = std::tan(M_PI * f0 / fs);
+    a0 = 1.0 + K / Q + K * K;
+    highpass[0] = 1.0;
+    highpass[1] = -2.0;
+    highpass[2] = 1.0;
+    highpass[3] = 2.0 * (K * K - 1.0) / a0;
+    highpass[4] = (1.0 - K / Q + K * K) / a0;
+
+    sub_block_frames = std::max<qint64>(1, (qint64)std::llround(fs / 10.0));
+
+    // From 192 kHz, the samples are close enough for the sample peak
+    oversampling = sampleRate < 96000 ? 4 : (sampleRate < 192000 ? 2 : 1);
+    peak_taps = oversampling > 1 ? PeakTaps : 1;
+    peak_filter.resize((size_t)oversampling * peak_taps);
+    const double half = peak_taps / 2;
+    for (int p = 1; p < oversampling; p++){
+        float *row = &peak_filter[(size_t)p * peak_taps];
+        double sum_abs = 0.0;
+        for (int j = 0; j < peak_taps; j++){
+            double t = j - (half - 1) - (double)p / oversampling;
+            double x = t / half;
+            double window = 0.5 + 0.5 * std::cos(M_PI * x);
+            row[j] = (float)(std::sin(M_PI * t) / (M_PI * t) * window);
+            sum_abs += std::abs(row[j]);
+        }
+        peak_bound = std::max(peak_bound, (float)sum_abs);
+    }
+    peak_history.assign((size_t)(peak_taps - 1) * channels, 0.0f);
+}
+
+/**
+ * Measure frames frames (frames * channels floats)
+ */
+void LoudnessMeter::process(const float *samples, qint64 frames)
+{
+    const int channels = nb_channels;
+    double *state = states.data();
+    const double *w = weights.data();
+
+    for (qint64 i = 0; i < frames; i++){
+        const float *frame = samples + i * channels;
+        double energy = 0.0;
+        for (int ch = 0; ch < channels; ch++){
+            // Two biquads in transposed direct form II
+            double *s = state + 4 * ch;
+            double x = frame[ch];
+            double y = shelf[0] * x + s[0];
+            s[0] = shelf[1] * x - shelf[3] * y + s[1];
+            s[1] = shelf[2] * x - shelf[4] * y;
+            double z = y + s[2];
+            s[2] = -2.0 * y - highpass[3] * z + s[3];
+            s[3] = y - highpass[4] * z;
+            energy += w[ch] * z * z;
+        }
+        sub_energy += energy;
+        if (++sub_count == sub_block_frames){
+            end_sub_block();
+        }
+    }
+    measure_peak(samples, frames);
+}
+
+/**
+ * Called at the end of each 100 ms, computes the energy of the last 400 ms
+ */
+void LoudnessMeter::end_sub_block()
+{
+    last_subs[nb_subs % 4] = sub_energy / sub_count;
+    nb_subs++;
+    sub_energy = 0.0;
+    sub_count = 0;
+    if (nb_subs < 4){
+        return;
+    }
+    // Blocks of 400 ms overlapping by 75 %
+    double power = (last_subs[0] + last_subs[1] + last_subs[2] + last_subs[3]) / 4.0;
+    if (-0.691 + 10.0 * std::log10(power) > -70.0){
+        blocks.push_back(power);
+    }
+}
+
+/**
+ * Update the true peak with the frames of a block
+ */
+void LoudnessMeter::measure_peak(const float *samples, qint64 frames)
+{
+    const int channels = nb_channels;
+    const qint64 count = frames * channels;
+    const size_t history_size = peak_history.size();
+
+    float block_max = 0.0f;
+    for (qint64 i = 0; i < count; i++){
+        block_max = std::max(block_max, std::abs(samples[i]));
+    }
+    float history_max = 0.0f;
+    for (size_t i = 0; i < history_size; i++){
+        history_max = std::max(history_max, std::abs(peak_history[i]));
+    }
+    peak = std::max(peak, block_max);
+
+    // Between the samples, the filter cannot go above the highest sample
+    // times its gain, most of the blocks do not need to be oversampled
+    if (oversampling > 1 && std::max(block_max, history_max) * peak_bound > peak){
+        peak_work.assign(peak_history.begin(), peak_history.end());
+        peak_work.insert(peak_work.end(), samples, samples + count);
+        for (qint64 n = 0; n < frames; n++){
+            const float *x = &peak_work[(size_t)n * channels];
+            for (int p = 1; p < oversampling; p++){
+                const float *h = &peak_filter[(size_t)p * peak_taps];
+                for (int ch = 0; ch < channels; ch++){
+                    float y = 0.0f;
+                    for (int j = 0; j < peak_taps; j++){
+                        y += h[j] * x[(size_t)j * channels + ch];
+                    }
+                    peak = std::max(peak, std::abs(y));
+                }
+            }
+        }
+    }
+
+    // Keep the last frames for the next block
+    if (history_size > 0){
+        if ((size_t)count >= history_size){
+            peak_history.assign(samples + count - history_size, samples + count);
+        }
+        else{
+            peak_history.erase(peak_history.begin(), peak_history.begin() + count);
+            peak_history.insert(peak_history.end(), samples, samples + count);
+        }
+    }
+}
+
+/**
+ * Returns the loudness of all the frames measured so far
+ */
+LoudnessInfo LoudnessMeter::result() const
+{
+    LoudnessInfo info;
+    info.truePeak = peak > 0.0f ? 20.0 * std::log10(peak) : -70.0;
+    if (blocks.empty()){
+        return info;
+    }
+
+    // Relative gate : 10 LU below the loudness of the blocks above the absolute gate
+    double sum = 0.0;
+    for (double power : blocks){
+        sum += power;
+    }
+    double threshold = sum / blocks.size() * std::pow(10.0, -10.0 / 10.0);
+    double gated = 0.0;
+    size_t nb_gated = 0;
+    for (double power : blocks){
+        if (power > threshold){
+            gated += power;
+            nb_gated++;
+        }
+    }
+    if (nb_gated == 0){
+        return info;
+    }
+    info.integrated = -0.691 + 10.0 * std::log10(gated / nb_gated);
+    info.valid = true;
+    return info;
+}
@@ -0,0 +1,109 @@
+#ifndef LOUDNESSMETER_H
+#define LOUDNESSMETER_H
+
+#include <QtGlobal>
+#include <vector>
+
+/**
+ * Loudness of a track measured by the LoudnessMeter
+ */
+struct LoudnessInfo
+{
+    //Bool defining if the track was long and loud enough to be measured
+    bool valid = false;
+
+    //Integrated loudness in LUFS (EBU R128 / ITU-R BS.1770)
+    double integrated = -70.0;
+
+    //Highest true peak in dBTP (dB relative to full scale, between the samples)
+    double truePeak = -70.0;
+
+    /**
+     * Returns the linear gain bringing the track to target LUFS
+     * without making its true peak go above ceiling dBTP
+     * (1 if the track could not be measured)
+     */
+    float gain(double target = -18.0, double ceiling = -1.0) const;
+};
+
+/**
+ * Measures the loudness of interleaved float samples while they are streamed.
+ *
+ * The samples are K-weighted and their energy is gated in 400 ms blocks
+ * (ITU-R BS.1770-4). The true peak is measured on the signal oversampled
+ * 4 times (2 times from 96 kHz), but only for the blocks which could
+ * raise it, so that the meter costs little more than the weighting filters.
+ */
+class LoudnessMeter
+{
+public:
+    //Loudness meter constructor, channelMask gives the speaker of each channel (0 if unknown)
+    LoudnessMeter(int channels, quint32 sampleRate, quint32 channelMask);
+
+    /**
+     * Measure frames frames (frames * channels floats)
+     */
+    void process(const float *samples, qint64 frames);
+
+    /**
+     * Returns the loudness of all the frames measured so far
+     */
+    LoudnessInfo result() const;
+
+private:
+    /**
+     * Called at the end of each 100 ms, computes the energy of the last 400 ms
+     */
+    void end_sub_block();
+
+    /**
+     * Update the true peak with the frames of a block
+     */
+    void measure_peak(const float *samples, qint64 frames);
+
+    //Number of interleaved channels
+    int nb_channels;
+
+    //Weight of each channel in the loudness (0 for the LFE)
+    std::vector<double> weights;
+
+    //Coefficients of the two K-weighting filters (b0, b1, b2, a1, a2)
+    double shelf[5];
+    double highpass[5];
+
+    //States of the two filters of each channel (2 per filter)
+    std::vector<double> states;
+
+    //Number of frames in 100 ms
+    qint64 sub_block_frames;
+
+    //Weighted energy and number of frames of the current 100 ms
+    double sub_energy = 0.0;
+    qint64 sub_count = 0;
+
+    //Mean energies of the last four 100 ms
+    double last_subs[4] = {0.0, 0.0, 0.0, 0.0};
+    int nb_subs = 0;
+
+    //Mean energy of each 400 ms block above the absolute gate (-70 LUFS)
+    std::vector<double> blocks;
+
+    //Oversampling factor of the true peak, and its filter (one row per phase)
+    int oversampling;
+    int peak_taps;
+    std::vector<float> peak_filter;
+
+    //Highest gain of the filter, the peak cannot grow above the samples times this bound
+    float peak_bound = 1.0f;
+
+    //Last frames of the previous block needed by the peak filter (interleaved)
+    std::vector<float> peak_history;
+
+    //Buffer of the history followed by the current block
+    std::vector<float> peak_work;
+
+    //Highest absolute value found, linear
+    float peak = 0.0f;
+};
+
+#endif // LOUDNESSMETER_H
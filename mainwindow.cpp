@@ -2,16 +2,36 @@
 #include "ui_mainwindow.h"
 
 #include <QMediaPlayer>
+#include <QAudioDeviceInfo>
 #include <QListWidgetItem>
 #include <QFileDialog>
 #include <QFile>
+#include <QFileInfo>
 #include <QTime>
-#include <QProcess>
 #include <QMessageBox>
+#include <QDragEnterEvent>
+#include <QDropEvent>
+#include <QKeyEvent>
+#include <QMimeData>
+#include <QStyle>
+#include <QInputDialog>
+#include <QtConcurrent>
+
+#include <memory>
+
+#include "audioengine.h"
+#include "wavfile.h"
+
+//Role of the playlist items holding the format detected at import (empty if invalid)
+static const int FormatRole = Qt::UserRole + 1;
+
+//Role of the playlist items holding true if the effects can be applied on the file
+static const int EffectsRole = Qt::UserRole + 2;
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , preview("temp.wav")
 {
     ui->setupUi(this);
 
@@ -22,6 +42,10 @@ MainWindow::MainWindow(QWidget *parent)
     //We create the player (of class QMediaPlayer) which is the main widget used
     player = new QMediaPlayer(this);
 
+    //The generated audio is played at the rate of the device (0 if there is no device)
+    QAudioDeviceInfo device = QAudioDeviceInfo::defaultOutputDevice();
+    device_rate = device.isNull() ? 0 : device.preferredFormat().sampleRate();
+
     //The buttons and effects are initialized (not clickable without audio selected)
     change_state_buttons(false);
     change_state_effects(false);
@@ -50,14 +74,48 @@ MainWindow::MainWindow(QWidget *parent)
 
     //When we double-click an audio in the playlist, play it
     connect(ui->playlist, SIGNAL(itemDoubleClicked(QListWidgetItem*)), this, SLOT(doubleClickAction(QListWidgetItem*)));
+
+    //The importer probes the files in background and sends them by batches to the playlist
+    importer = new AudioImporter(this);
+    connect(importer, &AudioImporter::batchReady, this, &MainWindow::add_imported_batch);
+    connect(importer, &AudioImporter::progress, this, &MainWindow::import_progress_changed);
+    connect(importer, &AudioImporter::finished, this, &MainWindow::import_finished);
+
+    //The import progress is shown in the status bar only while importing
+    import_progress = new QProgressBar(this);
+    import_progress->setMaximumWidth(200);
+    import_progress->setVisible(false);
+    ui->statusbar->addPermanentWidget(import_progress);
+
+    //The import can be cancelled from the status bar (or with Escape)
+    import_cancel = new QToolButton(this);
+    import_cancel->setText("Cancel");
+    import_cancel->setToolTip("Cancel the import (Esc)");
+    import_cancel->setVisible(false);
+    ui->statusbar->addPermanentWidget(import_cancel);
+    connect(import_cancel, &QToolButton::clicked, importer, &AudioImporter::cancel);
+
+    //Audio files and folders can be dropped on the window
+    setAcceptDrops(true);
 }
 
 MainWindow::~MainWindow()
 {
-    delete ui;
+    // The renders still running are cancelled, they stop at their next block and
+    // must be done before their files are removed (the temporary files are removed with preview)
+    cancel_render();
+    if (export_engine){
+        export_engine->cancel();
+    }
+    foreach (QFutureWatcherBase *watcher, findChildren<QFutureWatcherBase*>(QString(), Qt::FindDirectChildrenOnly)){
+        watcher->disconnect(this);
+        watcher->waitForFinished();
+    }
+    if (!export_output.isEmpty()){
+        QFile::remove(export_output);
+    }
 
-    // We remove the temporary file when destroying the main window
-    QFile::remove("temp.wav");
+    delete ui;
 }
 
 /** Change the state of the buttons (Enabled/ Not enabled)
@@ -75,7 +133,8 @@ void MainWindow::change_state_buttons(bool state){
  * @param state
  */
 void MainWindow::change_state_effects(bool state){
-    ui->ExportButton->setEnabled(state);
+    // Only one export runs at a time
+    ui->ExportButton->setEnabled(state && !export_engine);
     ui->SliderTempo->setEnabled(state);
     ui->SliderPitch->setEnabled(state);
     if (!state){
@@ -92,6 +151,10 @@ void MainWindow::change_state_effects(bool state){
  */
 void MainWindow::on_PlayButton_clicked()
 {
+    // The media is given to the player when its render is done
+    if (media_pending){
+        return;
+    }
     ui->title_playing->setText("Playing  :  "+current_item ->text());
     if (playing){
         player->pause();
@@ -132,6 +195,9 @@ void MainWindow::state_play(bool playing){
  */
 void MainWindow::on_StopButton_clicked()
 {
+    // A render still running is cancelled
+    cancel_render();
+    media_pending = false;
     player->stop();
     ui->title_playing->setText("");
     ui->cannot_label->setText("");
@@ -160,22 +226,31 @@ void MainWindow::on_playlist_itemClicked(QListWidgetItem *item)
 void MainWindow::doubleClickAction(QListWidgetItem *item)
 {
     on_playlist_itemClicked(item);
-    add_media();
-    QRegExp rx("[.]");// match a dot
-    QStringList list = item->text().split(rx);
-    QString codec = list.at(list.size()-1);
-    if (codec == "wav"){
+    // The files rejected at import are not given to the player
+    QString codec = item->data(FormatRole).toString();
+    if (codec.isEmpty() || !add_media()){
+        change_state_effects(false);
+        ui->cannot_label->setText("This file cannot be played.");
+        return;
+    }
+    if (item->data(EffectsRole).toBool()){
         change_state_effects(true);
         ui->cannot_label->setText("");
         ui->SliderTempo->setValue(0);
         ui->SliderPitch->setValue(0);
     }
+    else if (codec == "wav"){
+        change_state_effects(false);
+        ui->cannot_label->setText("You cannot apply effects on this Wav encoding.");
+    }
     else{
         change_state_effects(false);
         ui->cannot_label->setText("You cannot apply effects on non-Wav files.");
     }
     temp_generated = false;
-    on_PlayButton_clicked();
+    if (!media_pending){
+        on_PlayButton_clicked();
+    }
 }
 
 /**
@@ -237,7 +312,21 @@ void MainWindow::on_MuteButton_clicked()
  */
 void MainWindow::on_Volume_valueChanged(int value)
 {
-    player->setVolume(value);
+    Q_UNUSED(value);
+    update_volume();
+}
+
+/**
+ * Set the volume of the player from the volume slider
+ * and the normalization gain not applied yet in the media
+ */
+void MainWindow::update_volume()
+{
+    // The gain is the one of the file in the player, not of the selected item
+    float gain = normalize ? loudness_cache.value(media_path).gain() : 1.0f;
+    // The player cannot amplify, a louder media is only played at full volume
+    float remaining = qMin(1.0f, gain / media_gain);
+    player->setVolume(qRound(ui->Volume->value() * remaining));
 }
 
 /**
@@ -256,22 +345,116 @@ void MainWindow::on_actionOpen_triggered()
     add_to_playlist(input_files);
 }
 
+/**
+ * Slot performed when the open folder action is triggered
+ * Add to the playlist every audio file found in the folder
+ * and its subfolders
+ */
+void MainWindow::on_actionOpenFolder_triggered()
+{
+    QString folder = QFileDialog::getExistingDirectory(this, "Open a folder");
+    if (!folder.isEmpty()){
+        add_to_playlist(QStringList(folder));
+    }
+}
+
 /**
  * Add to playlist a list of strings.
- * A string here is a full path of an audio file
- * The item added to the playlist will have the name of the audio as text
- * and the file itself as data
+ * A string here is a full path of an audio file or a folder
+ * The files are probed asynchronously by the importer and added
+ * to the playlist by add_imported_batch
  */
 void MainWindow::add_to_playlist(QStringList input_files){
-    foreach(QString input, input_files){
+    importer->import(input_files);
+}
+
+/**
+ * Add to the playlist a batch of files probed by the importer
+ * The item added to the playlist will have the name of the audio as text
+ * and the file itself as data.
+ * Files that cannot be played are flagged with a warning icon
+ */
+void MainWindow::add_imported_batch(const QList<ImportResult> &batch){
+    // Repainting once per batch rather than once per item
+    ui->playlist->setUpdatesEnabled(false);
+    foreach(ImportResult result, batch){
         QListWidgetItem *newItem = new QListWidgetItem;
-        QVariant fullPath(input);
+        QVariant fullPath(result.path);
 
-        QFileInfo info(input);
-        newItem->setText(info.baseName()+"."+info.suffix());
+        QFileInfo info(result.path);
+        newItem->setText(info.fileName());
         newItem->setData(Qt::UserRole, fullPath);
+        if (result.valid){
+            newItem->setData(FormatRole, result.format);
+            newItem->setData(EffectsRole, result.effects);
+            // Valid WAV files in an encoding the engine does not read are played without effects
+            if (!result.error.isEmpty()){
+                newItem->setToolTip("Effects unavailable : "+result.error);
+            }
+        }
+        else{
+            newItem->setIcon(style()->standardIcon(QStyle::SP_MessageBoxWarning));
+            newItem->setToolTip(result.error);
+            newItem->setForeground(Qt::gray);
+        }
         ui->playlist->addItem(newItem);
     }
+    ui->playlist->setUpdatesEnabled(true);
+}
+
+/**
+ * Show the progress of the import in the status bar
+ */
+void MainWindow::import_progress_changed(int done, int total){
+    import_progress->setRange(0, total);
+    import_progress->setValue(done);
+    import_progress->setVisible(true);
+    import_cancel->setVisible(true);
+    ui->statusbar->showMessage("Importing "+QString::number(done)+" / "+QString::number(total)+" files");
+}
+
+/**
+ * Hide the import progress when the importer is done
+ */
+void MainWindow::import_finished(){
+    import_progress->setVisible(false);
+    import_cancel->setVisible(false);
+    ui->statusbar->clearMessage();
+}
+
+/**
+ * Accept audio files and folders dragged on the main window
+ */
+void MainWindow::dragEnterEvent(QDragEnterEvent *event){
+    if (event->mimeData()->hasUrls()){
+        event->acceptProposedAction();
+    }
+}
+
+/**
+ * Add to the playlist the audio files and folders dropped on the main window
+ */
+void MainWindow::dropEvent(QDropEvent *event){
+    QStringList input_files;
+    foreach(QUrl url, event->mimeData()->urls()){
+        if (url.isLocalFile()){
+            input_files << url.toLocalFile();
+        }
+    }
+    add_to_playlist(input_files);
+    event->acceptProposedAction();
+}
+
+/**
+ * Cancel the running import when Escape is pressed
+ */
+void MainWindow::keyPressEvent(QKeyEvent *event){
+    if (event->key() == Qt::Key_Escape && importer->isRunning()){
+        importer->cancel();
+        event->accept();
+        return;
+    }
+    QMainWindow::keyPressEvent(event);
 }
 
 /**
@@ -286,15 +469,58 @@ QFile* MainWindow::extractData(QListWidgetItem *item){
 /**
  * Add the audio of the current selected item in the playlist
  * to the player as a media
+ * Returns false if the file cannot be opened
  */
-void MainWindow::add_media(){
+bool MainWindow::add_media(){
     if (current_item != nullptr){
         QFile *audio = extractData(current_item);
-        audio->open(QIODevice::ReadOnly);
-        player->setMedia(0, audio);
+        if (!audio->open(QIODevice::ReadOnly)){
+            current_item->setIcon(style()->standardIcon(QStyle::SP_MessageBoxWarning));
+            current_item->setToolTip(audio->errorString());
+            delete audio;
+            return false;
+        }
+        // A render still running for the previous media is cancelled
+        cancel_render();
+        media_pending = false;
+        media_gain = 1.0f;
+        media_path = audio->fileName();
+        preview.setTempo(0);
         current_media_in_player = current_item->text();
         playing = false;
+        // The WAV files are converted to the rate of the device here rather than by the backend,
+        // they also go through the engine to be normalized : the player can lower the volume
+        // of a loud file but only the engine can amplify a quiet one. A file never measured
+        // goes through it once to be measured while it is rendered
+        if (current_item->data(EffectsRole).toBool()){
+            QString input = audio->fileName();
+            WavReader reader(input);
+            bool convert = device_rate != 0 && reader.open() && reader.format().sampleRate != device_rate;
+            bool amplify = normalize && (!loudness_cache.contains(input) || loudness_cache.value(input).gain() > 1.0f);
+            if (convert || amplify){
+                // The render is done in background, the player gets the media
+                // and starts playing when it is done (the original file if it failed)
+                delete audio;
+                player->setMedia(QMediaContent());
+                media_pending = true;
+                ui->statusbar->showMessage("Preparing "+current_item->text());
+                generate_audio_with_effect(input, 0, 0, [this, input](bool ok){
+                    media_pending = false;
+                    ui->statusbar->clearMessage();
+                    QFile *media = new QFile(ok ? preview.path() : input);
+                    media->open(QIODevice::ReadOnly);
+                    player->setMedia(0, media);
+                    update_volume();
+                    on_PlayButton_clicked();
+                });
+                return true;
+            }
+        }
+        player->setMedia(0, audio);
+        update_volume();
+        return true;
     }
+    return false;
 }
 
 
@@ -362,6 +588,16 @@ void MainWindow::on_RepeatOption_clicked()
     }
 }
 
+/**
+ * Slot performed when the normalize checkbox is checked
+ * The WAV files are played and exported at the same loudness
+ */
+void MainWindow::on_NormalizeOption_clicked()
+{
+    normalize = ui->NormalizeOption->isChecked();
+    update_volume();
+}
+
 /**
  * If the player is in state EndOfMedia, replay the audio
  */
@@ -384,14 +620,99 @@ void MainWindow::checkRepeat(QMediaPlayer::MediaStatus status)
  */
 void MainWindow::on_ExportButton_clicked()
 {
+    QString input = current_item ->data(Qt::UserRole).toString();
+    // The loudness is only known once the file has been rendered : if Normalize
+    // was checked after the file started playing, the export is refused rather
+    // than reading the whole file a second time
+    if (normalize && !loudness_cache.contains(input)){
+        ui->cannot_label->setText("Play the file again with Normalize checked before exporting it.");
+        return;
+    }
+
     QString filter ="Waveform Audio File Format Files (*.wav);;";
     QString name = QFileDialog::getSaveFileName(this, "Save file as", QString(), filter);
-    if (temp_generated){
-        QFile::copy("temp.wav", name);
+    if (name.isEmpty()){
+        return;
     }
-    else{
-        QFile::copy(extractData(current_item)->fileName(), name);
+
+    // The file keeps its rate unless another one is chosen
+    WavReader reader(input);
+    quint32 source_rate = reader.open() ? reader.format().sampleRate : 0;
+    QStringList choices;
+    QList<quint32> rates;
+    choices << "Original ("+QString::number(source_rate)+" Hz)";
+    rates << source_rate;
+    if (device_rate != 0 && device_rate != source_rate){
+        choices << "Audio device ("+QString::number(device_rate)+" Hz)";
+        rates << device_rate;
+    }
+    foreach (quint32 rate, QList<quint32>() << 44100 << 48000 << 88200 << 96000){
+        if (!rates.contains(rate)){
+            choices << QString::number(rate)+" Hz";
+            rates << rate;
+        }
+    }
+    bool chosen = false;
+    QString choice = QInputDialog::getItem(this, "Export", "Sample rate :", choices, 0, false, &chosen);
+    if (!chosen){
+        return;
+    }
+    quint32 export_rate = rates.value(choices.indexOf(choice), source_rate);
+
+    // The export is written next to the target and renamed when it is complete,
+    // so choosing the original file as target does not truncate it before it is read
+    QString part = name + ".part";
+    QFile::remove(part);
+    if (!temp_generated && export_rate == source_rate && !normalize){
+        if (!QFile::copy(input, part)){
+            ui->cannot_label->setText("Export failed : "+part+" cannot be written.");
+            return;
+        }
+        QFile::remove(name);
+        if (!QFile::rename(part, name)){
+            ui->cannot_label->setText("Export failed : the file was saved as "+part);
+        }
+        return;
     }
+
+    // The preview is made for the playback (rate of the device, fast conversion),
+    // the export is rendered again from the original file with the long filter,
+    // in the thread pool like the playback
+    const float gain = normalize ? loudness_cache.value(input).gain() : 1.0f;
+    const int tempo = ui->SliderTempo->value();
+    const int pitch = ui->SliderPitch->value();
+    std::shared_ptr<AudioEngine> engine = std::make_shared<AudioEngine>();
+    engine->setGain(gain);
+    export_engine = engine;
+    export_output = part;
+    ui->ExportButton->setEnabled(false);
+    ui->statusbar->showMessage("Exporting "+QFileInfo(name).fileName());
+
+    QFutureWatcher<bool> *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [=](){
+        watcher->deleteLater();
+        export_engine.reset();
+        export_output.clear();
+        ui->statusbar->clearMessage();
+        // The button follows the effects, which may have been disabled meanwhile
+        ui->ExportButton->setEnabled(ui->SliderTempo->isEnabled());
+
+        if (!watcher->result()){
+            QFile::remove(part);
+            ui->cannot_label->setText("Export failed : "+engine->errorString());
+            return;
+        }
+        loudness_cache.insert(input, engine->loudness());
+        QFile::remove(name);
+        if (!QFile::rename(part, name)){
+            ui->cannot_label->setText("Export failed : the file was saved as "+part);
+            return;
+        }
+        ui->statusbar->showMessage("Exported "+QFileInfo(name).fileName(), 3000);
+    });
+    watcher->setFuture(QtConcurrent::run([=](){
+        return engine->render(input, part, tempo, pitch, export_rate, Resampler::Export);
+    }));
 }
 
 /**
@@ -432,20 +753,71 @@ void MainWindow::on_SliderPitch_sliderReleased()
     switch_to_temp(tempo,pitch);
 }
 
+/**
+ * Cancel the render of the player still running (if any) : it stops at
+ * its next block and its result is discarded
+ */
+void MainWindow::cancel_render(){
+    render_id++;
+    if (render_engine){
+        render_engine->cancel();
+        render_engine.reset();
+    }
+}
+
 /**
  * Genrates a new audio file with tempo and pitch in input using
- * the soundstretch command
+ * the SoundTouch library, in the thread pool
+ * The audio is converted to the rate of the audio device, its loudness
+ * is measured and the normalization gain is applied if it is known
+ * When the render is done, the audio replaces the preview file and done is called
+ * with false if the audio cannot be generated. A render replaced by
+ * a newer one (or stopped) before its end is discarded and done is not called.
  */
-void MainWindow::generate_audio_with_effect(QString input,int tempoValue,int pitchValue){
-    QProcess process;
-    QString output = "temp.wav";
-    QString tempoArg = "-tempo=" + QString::number(tempoValue);
-    QString pitchArg = "-pitch=" + QString::number(pitchValue);
-    QStringList arguments;
-    arguments << input << output << tempoArg << pitchArg;
-    process.start("soundstretch",arguments);
-    process.waitForFinished();
-    process.close();
+void MainWindow::generate_audio_with_effect(QString input,int tempoValue,int pitchValue,
+                                            std::function<void(bool)> done){
+    // The previous render is cancelled. Each render has its own file,
+    // the player can still read the preview meanwhile
+    cancel_render();
+    const int id = render_id;
+    const QString output = preview.newRender();
+
+    // The loudness is measured in the same pass as the render, so the gain of
+    // a file never measured is only known after it : until its next render,
+    // the player can lower the volume but the file is not amplified
+    const float gain = normalize ? loudness_cache.value(input).gain() : 1.0f;
+    const quint32 rate = device_rate;
+    std::shared_ptr<AudioEngine> engine = std::make_shared<AudioEngine>();
+    engine->setGain(gain);
+    render_engine = engine;
+
+    QFutureWatcher<bool> *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [=](){
+        watcher->deleteLater();
+        bool ok = watcher->result();
+        if (ok){
+            loudness_cache.insert(input, engine->loudness());
+        }
+        if (id != render_id){
+            preview.discard(output);
+            return;
+        }
+        render_engine.reset();
+        if (ok){
+            ok = preview.replace(output);
+        }
+        else{
+            ui->cannot_label->setText("Effect failed : "+engine->errorString());
+            preview.discard(output);
+        }
+        if (ok){
+            media_gain = gain;
+        }
+        done(ok);
+    });
+    watcher->setFuture(QtConcurrent::run([=](){
+        return engine->render(input, output, tempoValue, pitchValue, rate, Resampler::Preview);
+    }));
 }
 
 /**
@@ -459,23 +831,25 @@ void MainWindow::generate_audio_with_effect(QString input,int tempoValue,int pit
 void MainWindow::switch_to_temp(int tempo,int pitch){
 
     QString input = current_item ->data(Qt::UserRole).toString();
-    generate_audio_with_effect(input,tempo,pitch);
-    temp_generated = true;
-    int maximum = ui->SliderAudio->maximum();
-    float progress_percentage = (float)ui->SliderAudio->value()/(float)maximum;
-        QFile* temp1= new QFile("temp.wav");
-        temp1->open(QIODevice::ReadOnly);
-        player->setMedia(0, temp1);
-    if (playing){
-        playing = false;
-    }
-    on_PlayButton_clicked();
-    //float new_total_duration = (float)maximum - (float)maximum * (float)tempo /(float)(tempo + previous_tempo);
-    //float new_total_duration = (float)maximum - (float)maximum * ((float)tempo+100-previous_tempo) /(float)previous_tempo;
-    float new_total_duration = (float)maximum * ((float)previous_tempo/(float)(tempo +100));
-    float new_progress = new_total_duration*(float)progress_percentage;
-    on_SliderAudio_sliderMoved((int)new_progress + 1);
-    previous_tempo = ui->SliderTempo->value() + 100;
+    // The previous audio is played until the new one is generated
+    generate_audio_with_effect(input, tempo, pitch, [this, tempo](bool ok){
+        // It also replaces a media which was being generated
+        media_pending = false;
+        if (!ok){
+            return;
+        }
+        temp_generated = true;
+        update_volume();
+        int position = preview.changeTempo(ui->SliderAudio->value(), tempo);
+            QFile* temp1= new QFile(preview.path());
+            temp1->open(QIODevice::ReadOnly);
+            player->setMedia(0, temp1);
+        if (playing){
+            playing = false;
+        }
+        on_PlayButton_clicked();
+        on_SliderAudio_sliderMoved(position);
+    });
 }
 
 
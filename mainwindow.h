@@ -5,6 +5,17 @@
 #include <QListWidgetItem>
 #include <QMediaPlayer>
 #include <QFile>
+#include <QProgressBar>
+#include <QToolButton>
+#include <QHash>
+
+#include <functional>
+#include <memory>
+
+#include "audioengine.h"
+#include "audioimporter.h"
+#include "loudnessmeter.h"
+#include "previewfile.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -89,6 +100,12 @@ private slots:
      */
     void on_Volume_valueChanged(int value);
 
+    /**
+     * Set the volume of the player from the volume slider
+     * and the normalization gain not applied yet in the media
+     */
+    void update_volume();
+
     /**
      * Slot performed when the open action is triggered
      * Add to the playlist the specified audio files in input
@@ -96,14 +113,39 @@ private slots:
      */
     void on_actionOpen_triggered();
 
+    /**
+     * Slot performed when the open folder action is triggered
+     * Add to the playlist every audio file found in the folder
+     * and its subfolders
+     */
+    void on_actionOpenFolder_triggered();
+
     /**
      * Add to playlist a list of strings.
-     * A string here is a full path of an audio file
-     * The item added to the playlist will have the name of the audio as text
-     * and the file itself as data
+     * A string here is a full path of an audio file or a folder
+     * The files are probed asynchronously by the importer and added
+     * to the playlist by add_imported_batch
      */
     void add_to_playlist(QStringList input_files);
 
+    /**
+     * Add to the playlist a batch of files probed by the importer
+     * The item added to the playlist will have the name of the audio as text
+     * and the file itself as data.
+     * Files that cannot be played are flagged with a warning icon
+     */
+    void add_imported_batch(const QList<ImportResult> &batch);
+
+    /**
+     * Show the progress of the import in the status bar
+     */
+    void import_progress_changed(int done, int total);
+
+    /**
+     * Hide the import progress when the importer is done
+     */
+    void import_finished();
+
     /**
      * Returns the data (QFile* in this case) of an item in the playlist
      */
@@ -112,8 +154,10 @@ private slots:
     /**
      * Add the audio of the current selected item in the playlist
      * to the player as a media
+     * If the audio has to be generated first, it is played when it is ready
+     * Returns false if the file cannot be opened
      */
-    void add_media();
+    bool add_media();
 
     /**
      * Delete the selected item in the playlist
@@ -147,6 +191,12 @@ private slots:
      */
     void on_RepeatOption_clicked();
 
+    /**
+     * Slot performed when the normalize checkbox is checked
+     * The WAV files are played and exported at the same loudness
+     */
+    void on_NormalizeOption_clicked();
+
     /**
      * If the player is in state EndOfMedia, replay the audio
      */
@@ -179,12 +229,6 @@ private slots:
      */
     void on_SliderPitch_sliderReleased();
 
-    /**
-     * Genrates a new audio file with tempo and pitch in input using
-     * the soundstretch command
-     */
-    void generate_audio_with_effect(QString input,int tempoValue,int pitchValue);
-
     /**
      * When applying effects (by changing tempo and pitch),
      * the player plays the generated temporary file and plays it
@@ -205,13 +249,59 @@ private slots:
      */
     void on_actionQuit_triggered();
 
+protected:
+    /**
+     * Accept audio files and folders dragged on the main window
+     */
+    void dragEnterEvent(QDragEnterEvent *event) override;
+
+    /**
+     * Add to the playlist the audio files and folders dropped on the main window
+     */
+    void dropEvent(QDropEvent *event) override;
+
+    /**
+     * Cancel the running import when Escape is pressed
+     */
+    void keyPressEvent(QKeyEvent *event) override;
+
 private:
+    /**
+     * Genrates a new audio file with tempo and pitch in input using
+     * the SoundTouch library, in the thread pool
+     * The audio is converted to the rate of the audio device, its loudness
+     * is measured and the normalization gain is applied if it is known
+     * When the render is done, the audio replaces the preview file and done is called
+     * with false if the audio cannot be generated. A render replaced by
+     * a newer one (or stopped) before its end is discarded and done is not called.
+     */
+    void generate_audio_with_effect(QString input,int tempoValue,int pitchValue,
+                                    std::function<void(bool)> done);
+
+    /**
+     * Cancel the render of the player still running (if any) : it stops at
+     * its next block and its result is discarded
+     */
+    void cancel_render();
+
     // The Main Window
     Ui::MainWindow *ui;
 
     //The player used to play the audio files
     QMediaPlayer *player;
 
+    //Sample rate of the audio output device, the generated audio is converted to it
+    quint32 device_rate = 0;
+
+    //Probes the imported files outside of the GUI thread
+    AudioImporter *importer;
+
+    //Progress of the import shown in the status bar
+    QProgressBar *import_progress;
+
+    //Button of the status bar cancelling the import
+    QToolButton *import_cancel;
+
     //Bool defining if the player is playing or not
     bool playing = false;
 
@@ -221,18 +311,45 @@ private:
     //Bool defining if player plays an audio repeatedly or not
     bool repeat = false;
 
+    //Bool defining if the loudness of the WAV files is normalized or not
+    bool normalize = false;
+
+    //Loudness of the WAV files already read, by full path
+    QHash<QString, LoudnessInfo> loudness_cache;
+
+    //Normalization gain already applied in the media of the player
+    float media_gain = 1.0f;
+
+    //Full path of the file given to the player (before any render)
+    QString media_path;
+
     //Name of the current File set in the player
     QString current_media_in_player;
 
     //Current item chosen in the playlist
-    QListWidgetItem *current_item;
+    QListWidgetItem *current_item = nullptr;
 
     //Bool defining if a temporary file was generated or not
     bool temp_generated =false;
 
-    /** Saving the last tempo,
+    //Bool defining if the media is being generated before being given to the player
+    bool media_pending = false;
+
+    //Number of the last render started, the results of the previous ones are discarded
+    int render_id = 0;
+
+    //Engine of the render of the player still running, null if none
+    std::shared_ptr<AudioEngine> render_engine;
+
+    //Engine of the export running, null if none
+    std::shared_ptr<AudioEngine> export_engine;
+
+    //File written by the export running, empty if none
+    QString export_output;
+
+    /** Temporary file played after applying an effect, with its tempo
      * used when the player wants to play a file after applying an effect
      */
-    int previous_tempo = 100;
+    PreviewFile preview;
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,97 @@
+#include "previewfile.h"
+#include "audioengine.h"
+
+#include <QFile>
+
+//Preview file constructor, path is the file given to the player
+PreviewFile::PreviewFile(const QString &path)
+    : file_path(path)
+{
+}
+
+//Preview file destructor, removes the played file and the unfinished renders
+PreviewFile::~PreviewFile()
+{
+    foreach (QString rendered, renders){
+        QFile::remove(rendered);
+    }
+    QFile::remove(file_path);
+}
+
+/**
+ * Returns the path of the file given to the player
+ */
+QString PreviewFile::path() const
+{
+    return file_path;
+}
+
+/**
+ * Returns the path of a new file for a render
+ */
+QString PreviewFile::newRender()
+{
+    QString rendered = file_path + ".part" + QString::number(++nb_renders);
+    renders << rendered;
+    return rendered;
+}
+
+/**
+ * Replace the played file by the complete render rendered
+ * Returns false if it cannot be replaced (the render is then removed)
+ */
+bool PreviewFile::replace(const QString &rendered)
+{
+    // A render which was not written does not remove the played file
+    if (!QFile::exists(rendered)){
+        discard(rendered);
+        return false;
+    }
+    // The player still reads the previous file through its own handle
+    QFile::remove(file_path);
+    if (!QFile::rename(rendered, file_path)){
+        discard(rendered);
+        return false;
+    }
+    renders.removeOne(rendered);
+    return true;
+}
+
+/**
+ * Remove a render which will not be played
+ */
+void PreviewFile::discard(const QString &rendered)
+{
+    QFile::remove(rendered);
+    renders.removeOne(rendered);
+}
+
+/**
+ * Returns the tempo change of the played audio (in percent)
+ */
+int PreviewFile::tempo() const
+{
+    return current_tempo;
+}
+
+/**
+ * Set the tempo change of the played audio, 0 when a new file is played
+ */
+void PreviewFile::setTempo(int tempo)
+{
+    current_tempo = tempo;
+}
+
+/**
+ * Returns the position (in seconds) where the audio generated with the
+ * tempo change newTempo continues the played audio at position, and
+ * keeps newTempo as the tempo change of the played audio
+ */
+int PreviewFile::changeTempo(int position, int newTempo)
+{
+    double mapped = AudioEngine::mapPosition(position, current_tempo, newTempo);
+    current_tempo = newTempo;
+    // The slider of the player gives whole seconds, the new audio starts at
+    // the next second so that nothing already heard is played again
+    return (int)mapped + 1;
+}
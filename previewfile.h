@@ -0,0 +1,77 @@
+#ifndef PREVIEWFILE_H
+#define PREVIEWFILE_H
+
+#include <QString>
+#include <QStringList>
+
+/**
+ * Temporary WAV file given to the player when the audio is generated
+ * (effects, conversion to the rate of the device, normalization).
+ *
+ * Each render writes its own file, which replaces the played file only
+ * once it is complete, so the player keeps the previous audio meanwhile.
+ * The tempo change of the played audio is kept to find the position
+ * of the player in the next audio.
+ */
+class PreviewFile
+{
+public:
+    //Preview file constructor, path is the file given to the player
+    explicit PreviewFile(const QString &path);
+
+    //Preview file destructor, removes the played file and the unfinished renders
+    ~PreviewFile();
+
+    /**
+     * Returns the path of the file given to the player
+     */
+    QString path() const;
+
+    /**
+     * Returns the path of a new file for a render
+     */
+    QString newRender();
+
+    /**
+     * Replace the played file by the complete render rendered
+     * Returns false if it cannot be replaced (the render is then removed)
+     */
+    bool replace(const QString &rendered);
+
+    /**
+     * Remove a render which will not be played
+     */
+    void discard(const QString &rendered);
+
+    /**
+     * Returns the tempo change of the played audio (in percent)
+     */
+    int tempo() const;
+
+    /**
+     * Set the tempo change of the played audio, 0 when a new file is played
+     */
+    void setTempo(int tempo);
+
+    /**
+     * Returns the position (in seconds) where the audio generated with the
+     * tempo change newTempo continues the played audio at position, and
+     * keeps newTempo as the tempo change of the played audio
+     */
+    int changeTempo(int position, int newTempo);
+
+private:
+    //Path of the file given to the player
+    QString file_path;
+
+    //Files of the renders not finished yet
+    QStringList renders;
+
+    //Number of renders created, gives the name of the next one
+    int nb_renders = 0;
+
+    //Tempo change of the played audio (in percent)
+    int current_tempo = 0;
+};
+
+#endif // PREVIEWFILE_H
@@ -0,0 +1,164 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//Maximum number of phases stored, above that the phases are interpolated
+static const qint64 MaxPhases = 1024;
+
+/**
+ * Modified Bessel function of the first kind, used by the Kaiser window
+ */
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50 && term > sum * 1e-12; k++){
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+//Resampler constructor
+Resampler::Resampler(int channels, quint32 inputRate, quint32 outputRate, Quality quality)
+    : nb_channels(channels)
+{
+    qint64 a = inputRate;
+    qint64 b = outputRate;
+    while (b != 0){
+        qint64 r = a % b;
+        a = b;
+        b = r;
+    }
+    up = outputRate / a;
+    down = inputRate / a;
+
+    // When the rate is reduced, the cutoff follows the output Nyquist frequency
+    // and the filter gets longer in input frames to keep the same sharpness
+    double scale = std::min(1.0, (double)up / (double)down);
+    double cutoff = scale * (quality == Preview ? 0.90 : 0.96);
+    double beta = (quality == Preview ? 6.0 : 10.0);
+    int base_taps = (quality == Preview ? 16 : 64);
+    taps = std::min(1024, (int)std::ceil(base_taps / scale));
+    taps += taps & 1;
+
+    phases = (int)std::min(up, MaxPhases);
+    table.resize((size_t)(phases + 1) * taps);
+    const double half = taps / 2;
+    const double i0_beta = bessel_i0(beta);
+    for (int p = 0; p <= phases; p++){
+        float *row = &table[(size_t)p * taps];
+        double frac = (double)p / phases;
+        double sum = 0.0;
+        for (int j = 0; j < taps; j++){
+            double t = j - (half - 1) - frac;
+            double x = t / half;
+            double window = std::abs(x) < 1.0 ? bessel_i0(beta * std::sqrt(1.0 - x * x)) / i0_beta : 0.0;
+            double arg = M_PI * cutoff * t;
+            double sinc = std::abs(arg) < 1e-9 ? 1.0 : std::sin(arg) / arg;
+            row[j] = (float)(cutoff * sinc * window);
+            sum += row[j];
+        }
+        // Each phase has a gain of 1 for a constant signal
+        for (int j = 0; j < taps; j++){
+            row[j] = (float)(row[j] / sum);
+        }
+    }
+
+    // Zeros before the first frame so that the first output is aligned with it
+    position = taps / 2 - 1;
+    phase = 0;
+    history.assign((size_t)position * nb_channels, 0.0f);
+    acc.resize(nb_channels);
+}
+
+/**
+ * Convert frames frames of input and append the result to output
+ * Returns the number of frames appended
+ */
+qint64 Resampler::process(const float *input, qint64 frames, std::vector<float> &output)
+{
+    history.insert(history.end(), input, input + frames * nb_channels);
+    frames_in += frames;
+    return produce(output, std::numeric_limits<qint64>::max());
+}
+
+/**
+ * Append to output the frames still waiting for the next input
+ * Returns the number of frames appended
+ */
+qint64 Resampler::flush(std::vector<float> &output)
+{
+    history.resize(history.size() + (size_t)(taps / 2) * nb_channels, 0.0f);
+    // The output lasts exactly as long as the input
+    qint64 total = (frames_in * up + down - 1) / down;
+    return produce(output, total);
+}
+
+/**
+ * Returns the number of channels
+ */
+int Resampler::channels() const
+{
+    return nb_channels;
+}
+
+/**
+ * Produce the output frames which have all their input available,
+ * without going beyond limit output frames in total
+ */
+qint64 Resampler::produce(std::vector<float> &output, qint64 limit)
+{
+    const int channels = nb_channels;
+    const qint64 available = history.size() / channels;
+    const bool exact = (phases == up);
+    std::vector<float> interpolated(exact ? 0 : taps);
+    qint64 produced = 0;
+
+    while (position + taps / 2 < available && frames_out < limit){
+        const float *coef;
+        if (exact){
+            coef = &table[(size_t)phase * taps];
+        }
+        else{
+            // The phase falls between two rows of the table
+            double index = (double)phase * phases / up;
+            int row = (int)index;
+            float frac = (float)(index - row);
+            const float *r0 = &table[(size_t)row * taps];
+            const float *r1 = r0 + taps;
+            for (int j = 0; j < taps; j++){
+                interpolated[j] = r0[j] + frac * (r1[j] - r0[j]);
+            }
+            coef = interpolated.data();
+        }
+
+        // The channels of a frame are contiguous, the inner loop is vectorized over them
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        const float *x = &history[(size_t)(position - taps / 2 + 1) * channels];
+        for (int j = 0; j < taps; j++){
+            const float c = coef[j];
+            const float *frame = x + (size_t)j * channels;
+            for (int ch = 0; ch < channels; ch++){
+                acc[ch] += c * frame[ch];
+            }
+        }
+        output.insert(output.end(), acc.begin(), acc.end());
+        produced++;
+        frames_out++;
+
+        phase += down;
+        position += phase / up;
+        phase %= up;
+    }
+
+    // The frames before the filter of the next output are not needed anymore
+    qint64 drop = std::min(position - (taps / 2 - 1), available);
+    if (drop > 0){
+        history.erase(history.begin(), history.begin() + (size_t)drop * channels);
+        position -= drop;
+    }
+    return produced;
+}
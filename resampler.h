@@ -0,0 +1,86 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <QtGlobal>
+#include <vector>
+
+/**
+ * Converts interleaved float samples from one sample rate to another
+ * with a polyphase windowed-sinc filter.
+ *
+ * The samples are streamed : process() can be called with blocks of any
+ * size and flush() gives the last samples, so that the output has exactly
+ * frames * outputRate / inputRate frames, aligned with the input.
+ */
+class Resampler
+{
+public:
+    //Quality of the conversion
+    enum Quality {
+        //Short filter for the playback, fast enough for realtime
+        Preview,
+        //Long filter with a high rejection of the aliasing, for the export
+        Export
+    };
+
+    //Resampler constructor
+    Resampler(int channels, quint32 inputRate, quint32 outputRate, Quality quality);
+
+    /**
+     * Convert frames frames of input and append the result to output
+     * Returns the number of frames appended
+     */
+    qint64 process(const float *input, qint64 frames, std::vector<float> &output);
+
+    /**
+     * Append to output the frames still waiting for the next input
+     * Returns the number of frames appended
+     */
+    qint64 flush(std::vector<float> &output);
+
+    /**
+     * Returns the number of channels
+     */
+    int channels() const;
+
+private:
+    /**
+     * Produce the output frames which have all their input available,
+     * without going beyond limit output frames in total
+     */
+    qint64 produce(std::vector<float> &output, qint64 limit);
+
+    //Number of interleaved channels
+    int nb_channels;
+
+    //The output rate is input rate * up / down (reduced fraction)
+    qint64 up;
+    qint64 down;
+
+    //Number of input frames used for one output frame
+    int taps;
+
+    //Number of filter phases stored in the table
+    int phases;
+
+    //Coefficients of the filter, taps per phase (phases + 1 rows)
+    std::vector<float> table;
+
+    //Input frames not consumed yet (interleaved)
+    std::vector<float> history;
+
+    //Index in history of the input frame of the next output
+    qint64 position;
+
+    //Fractional position of the next output, in 1/up of input frame
+    qint64 phase;
+
+    //Number of input frames received and output frames produced
+    qint64 frames_in = 0;
+    qint64 frames_out = 0;
+
+    //Accumulator of one output frame
+    std::vector<float> acc;
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,33 @@
+QT       += testlib concurrent
+QT       -= gui
+
+# The time budgets are given for optimized code
+CONFIG += c++11 console testcase release
+CONFIG -= app_bundle
+
+TARGET = tst_audiopipeline
+
+# Regression tests of the audio pipeline, run them with "make check".
+# The audio is only rendered to files, no audio device is needed.
+# The time budgets can be scaled with SOUNDCHANGE_BUDGET_SCALE (0 skips them)
+INCLUDEPATH += ..
+
+SOURCES += \
+    tst_audiopipeline.cpp \
+    ../audioengine.cpp \
+    ../audioimporter.cpp \
+    ../loudnessmeter.cpp \
+    ../previewfile.cpp \
+    ../resampler.cpp \
+    ../wavfile.cpp
+
+HEADERS += \
+    ../audioengine.h \
+    ../audioimporter.h \
+    ../loudnessmeter.h \
+    ../previewfile.h \
+    ../resampler.h \
+    ../wavfile.h
+
+unix: LIBS += -lSoundTouch
+unix: QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize
@@ -0,0 +1,947 @@
+#include "audioengine.h"
+#include "audioimporter.h"
+#include "loudnessmeter.h"
+#include "previewfile.h"
+#include "resampler.h"
+#include "wavfile.h"
+
+#include <QtTest>
+#include <QtConcurrent>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+/**
+ * Renders synthetic fixtures (sines, chirps, clicks) through the audio engine
+ * and compares the output with the expected (golden) durations, frequencies
+ * and positions, within tolerances. The renders are also timed against
+ * per-case budgets, with a margin for the load of the machine. The budgets
+ * are scaled by SOUNDCHANGE_BUDGET_SCALE (0 skips them).
+ *
+ * The probe of the importer is checked on hand-made headers, and the
+ * imports of folders must keep the sorted order of the files.
+ *
+ * Every fixture is generated by the test itself so the results do not
+ * depend on any file or audio device.
+ */
+class TestAudioPipeline : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void sine_data();
+    void sine();
+
+    void chirp_data();
+    void chirp();
+
+    void previewSeek_data();
+    void previewSeek();
+
+    void previewReplace();
+
+    void clicks_data();
+    void clicks();
+
+    void highResolution();
+
+    void readError();
+
+    void cancel();
+
+    void loudness();
+
+    void throughput_data();
+    void throughput();
+
+    void probe_data();
+    void probe();
+
+    void importUnreadable();
+
+    void importOrder();
+
+private:
+    /**
+     * Returns the path of a file in the temporary directory
+     */
+    QString path(const QString &name) const;
+
+    //Directory of the fixtures and of the rendered files
+    QTemporaryDir dir;
+};
+
+//Length of the sine fixture in seconds and its frequency
+static const double SineSeconds = 3.0;
+static const double SineFrequency = 440.0;
+
+//Length and frequencies of the exponential chirp fixture
+static const double ChirpSeconds = 4.0;
+static const double ChirpStart = 200.0;
+static const double ChirpEnd = 3200.0;
+
+//Position of the first click and time between two clicks in the clicks fixture
+static const double ClickStart = 0.1;
+static const double ClickPeriod = 0.25;
+static const double ClickSeconds = 3.0;
+
+//Margin of the time budgets : a render only fails above twice its budget
+static const double BudgetMargin = 2.0;
+
+/**
+ * Returns the factor applied to the time budgets (SOUNDCHANGE_BUDGET_SCALE,
+ * 1 by default, 0 skips the budgets)
+ */
+static double budget_scale()
+{
+    bool ok = false;
+    double scale = qEnvironmentVariable("SOUNDCHANGE_BUDGET_SCALE").toDouble(&ok);
+    return ok && scale >= 0.0 ? scale : 1.0;
+}
+
+/**
+ * Returns true if elapsed fits in budget (in the same unit),
+ * with the margin and the scale of the budgets
+ */
+static bool within_budget(double elapsed, double budget)
+{
+    double scale = budget_scale();
+    return scale == 0.0 || elapsed <= budget * BudgetMargin * scale;
+}
+
+/**
+ * Write interleaved samples in a WAV file of the given format
+ */
+static void write_wav(const QString &path, const WavFormat &format, const std::vector<float> &samples)
+{
+    WavWriter writer(path, format);
+    QVERIFY2(writer.open(), qPrintable(writer.errorString()));
+    QVERIFY(writer.write(samples.data(), samples.size() / format.channels));
+    QVERIFY2(writer.close(), qPrintable(writer.errorString()));
+}
+
+/**
+ * Read every sample of a WAV file
+ */
+static std::vector<float> read_wav(const QString &path, WavFormat &format)
+{
+    WavReader reader(path);
+    std::vector<float> samples;
+    if (!reader.open()){
+        qWarning() << path << reader.errorString();
+        return samples;
+    }
+    format = reader.format();
+    samples.resize((size_t)reader.frameCount() * format.channels);
+    qint64 frames = reader.read(samples.data(), reader.frameCount());
+    samples.resize((size_t)frames * format.channels);
+    return samples;
+}
+
+/**
+ * Returns the samples of one channel
+ */
+static std::vector<float> channel(const std::vector<float> &samples, int channels, int index)
+{
+    std::vector<float> result(samples.size() / channels);
+    for (size_t i = 0; i < result.size(); i++){
+        result[i] = samples[i * channels + index];
+    }
+    return result;
+}
+
+/**
+ * In place radix-2 FFT, the size must be a power of 2
+ */
+static void fft(std::vector<std::complex<double>> &x)
+{
+    const size_t n = x.size();
+    for (size_t i = 1, j = 0; i < n; i++){
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1){
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j){
+            std::swap(x[i], x[j]);
+        }
+    }
+    for (size_t len = 2; len <= n; len <<= 1){
+        std::complex<double> step = std::polar(1.0, -2.0 * M_PI / len);
+        for (size_t i = 0; i < n; i += len){
+            std::complex<double> w = 1.0;
+            for (size_t k = 0; k < len / 2; k++){
+                std::complex<double> a = x[i + k];
+                std::complex<double> b = x[i + k + len / 2] * w;
+                x[i + k] = a + b;
+                x[i + k + len / 2] = a - b;
+                w *= step;
+            }
+        }
+    }
+}
+
+/**
+ * Power spectrum of size samples (power of 2) centered on center,
+ * with a Hann window. The samples outside of the signal are zeros.
+ */
+static std::vector<double> spectrum(const std::vector<float> &signal, qint64 center, int size)
+{
+    std::vector<std::complex<double>> x(size);
+    for (int i = 0; i < size; i++){
+        qint64 index = center - size / 2 + i;
+        double sample = (index >= 0 && index < (qint64)signal.size()) ? signal[index] : 0.0;
+        x[i] = sample * (0.5 - 0.5 * std::cos(2.0 * M_PI * i / size));
+    }
+    fft(x);
+    std::vector<double> power(size / 2);
+    for (int k = 0; k < size / 2; k++){
+        power[k] = std::norm(x[k]);
+    }
+    return power;
+}
+
+/**
+ * Returns the frequency of the highest peak of the spectrum (interpolated between the bins)
+ */
+static double peak_frequency(const std::vector<double> &power, quint32 rate)
+{
+    size_t best = 1;
+    for (size_t k = 1; k + 1 < power.size(); k++){
+        if (power[k] > power[best]){
+            best = k;
+        }
+    }
+    double a = std::log(power[best - 1] + 1e-30);
+    double b = std::log(power[best] + 1e-30);
+    double c = std::log(power[best + 1] + 1e-30);
+    double offset = 0.5 * (a - c) / (a - 2.0 * b + c);
+    return (best + offset) * rate / (2.0 * power.size());
+}
+
+/**
+ * Returns the part of the power of the spectrum within tolerance (relative) of frequency
+ */
+static double power_ratio(const std::vector<double> &power, quint32 rate, double frequency, double tolerance)
+{
+    double total = 0.0;
+    double around = 0.0;
+    for (size_t k = 0; k < power.size(); k++){
+        double f = k * rate / (2.0 * power.size());
+        total += power[k];
+        if (std::abs(f - frequency) <= frequency * tolerance){
+            around += power[k];
+        }
+    }
+    return total > 0.0 ? around / total : 0.0;
+}
+
+/**
+ * Returns the positions (in frames) of the clicks : the highest sample of each
+ * group of samples above threshold, the groups being separated by 50 ms at least
+ */
+static std::vector<qint64> find_clicks(const std::vector<float> &signal, quint32 rate, float threshold)
+{
+    std::vector<qint64> clicks;
+    const qint64 gap = rate / 20;
+    qint64 i = 0;
+    while (i < (qint64)signal.size()){
+        if (std::abs(signal[i]) < threshold){
+            i++;
+            continue;
+        }
+        qint64 best = i;
+        for (qint64 j = i; j < qMin<qint64>(i + gap / 5, signal.size()); j++){
+            if (std::abs(signal[j]) > std::abs(signal[best])){
+                best = j;
+            }
+        }
+        clicks.push_back(best);
+        i = best + gap;
+    }
+    return clicks;
+}
+
+/**
+ * Returns seconds of sine on each channel, the frequency of channel c being frequency * (c + 1)
+ */
+static std::vector<float> make_sines(int channels, quint32 rate, double seconds, double frequency, double amplitude)
+{
+    qint64 frames = (qint64)std::llround(seconds * rate);
+    std::vector<float> samples((size_t)frames * channels);
+    for (qint64 i = 0; i < frames; i++){
+        for (int c = 0; c < channels; c++){
+            samples[(size_t)i * channels + c] = (float)(amplitude * std::sin(2.0 * M_PI * frequency * (c + 1) * i / rate));
+        }
+    }
+    return samples;
+}
+
+/**
+ * Returns the format of a PCM or float fixture
+ */
+static WavFormat make_format(int channels, quint32 rate, int bits, bool is_float)
+{
+    WavFormat format;
+    format.channels = channels;
+    format.sampleRate = rate;
+    format.bitsPerSample = bits;
+    format.isFloat = is_float;
+    return format;
+}
+
+/**
+ * Returns the bytes of a WAV file with the format tag, sample size and block
+ * size given, and data_size bytes of silence
+ */
+static QByteArray riff_wav(quint16 tag, quint16 bits, quint16 block_align, int data_size)
+{
+    QByteArray bytes;
+    QDataStream out(&bytes, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData("RIFF", 4);
+    out << (quint32)(4 + 24 + 8 + data_size);
+    out.writeRawData("WAVE", 4);
+    out.writeRawData("fmt ", 4);
+    out << (quint32)16 << tag << (quint16)1 << (quint32)8000 << (quint32)(8000 * block_align)
+        << block_align << bits;
+    out.writeRawData("data", 4);
+    out << (quint32)data_size;
+    out.writeRawData(QByteArray(data_size, '\0').constData(), data_size);
+    return bytes;
+}
+
+/**
+ * Write bytes in a new file
+ */
+static bool write_bytes(const QString &path, const QByteArray &bytes)
+{
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(bytes) == bytes.size();
+}
+
+/**
+ * Returns the path of a file in the temporary directory
+ */
+QString TestAudioPipeline::path(const QString &name) const
+{
+    return dir.filePath(name);
+}
+
+/**
+ * Generate the fixtures, as 16 bit PCM like most of the WAV files
+ */
+void TestAudioPipeline::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    const quint32 rate = 44100;
+
+    // Stereo sines at 44.1 kHz, and at 96 kHz where SoundTouch uses its quick search
+    const quint32 sine_rates[] = {rate, 96000};
+    for (quint32 sine_rate : sine_rates){
+        std::vector<float> sine = make_sines(2, sine_rate, SineSeconds, SineFrequency, 0.5);
+        for (size_t i = 1; i < sine.size(); i += 2){
+            // Both channels play the same sine
+            sine[i] = sine[i - 1];
+        }
+        write_wav(path(QString("sine_%1.wav").arg(sine_rate)), make_format(2, sine_rate, 16, false), sine);
+    }
+
+    // Exponential chirp : one octave per second
+    qint64 frames = (qint64)(ChirpSeconds * rate);
+    std::vector<float> chirp(frames);
+    const double k = std::log(ChirpEnd / ChirpStart) / ChirpSeconds;
+    for (qint64 i = 0; i < frames; i++){
+        double t = (double)i / rate;
+        chirp[i] = (float)(0.5 * std::sin(2.0 * M_PI * ChirpStart * (std::exp(k * t) - 1.0) / k));
+    }
+    write_wav(path("chirp.wav"), make_format(1, rate, 16, false), chirp);
+
+    frames = (qint64)(ClickSeconds * rate);
+    std::vector<float> clicks((size_t)frames * 2, 0.0f);
+    for (double t = ClickStart; t < ClickSeconds; t += ClickPeriod){
+        qint64 i = (qint64)std::llround(t * rate);
+        clicks[i * 2] = 0.9f;
+        clicks[i * 2 + 1] = 0.9f;
+    }
+    write_wav(path("clicks.wav"), make_format(2, rate, 16, false), clicks);
+}
+
+/**
+ * Tempo and pitch settings of the sliders, with the expected results
+ */
+void TestAudioPipeline::sine_data()
+{
+    QTest::addColumn<int>("inputRate");
+    QTest::addColumn<int>("tempo");
+    QTest::addColumn<int>("pitch");
+    QTest::addColumn<int>("outputRate");
+    QTest::addColumn<int>("quality");
+    QTest::addColumn<double>("duration");
+    QTest::addColumn<double>("frequency");
+
+    const int tempos[] = {-50, -25, 0, 50, 100, 200};
+    const int pitches[] = {-10, -5, 0, 5, 10};
+    for (int tempo : tempos){
+        for (int pitch : pitches){
+            QTest::addRow("tempo %d pitch %d", tempo, pitch)
+                    << 44100 << tempo << pitch << 0 << (int)Resampler::Export
+                    << SineSeconds * 100.0 / (tempo + 100) << SineFrequency * std::pow(2.0, pitch / 12.0);
+        }
+    }
+    // Playback on a 48 kHz device : the conversion is fused with the pitch change for the preview
+    QTest::newRow("preview 48k tempo 50 pitch 5") << 44100 << 50 << 5 << 48000 << (int)Resampler::Preview
+                                                  << 2.0 << 587.330;
+    QTest::newRow("preview 48k tempo -25 pitch -7") << 44100 << -25 << -7 << 48000 << (int)Resampler::Preview
+                                                    << 4.0 << 293.665;
+    QTest::newRow("export 48k tempo 100 pitch 3") << 44100 << 100 << 3 << 48000 << (int)Resampler::Export
+                                                  << 1.5 << 523.251;
+    // Above 48 kHz the stretch uses the quick search, whatever the number of channels
+    QTest::newRow("stereo 96k tempo 50 pitch 3") << 96000 << 50 << 3 << 0 << (int)Resampler::Export
+                                                 << 2.0 << 523.251;
+    QTest::newRow("stereo 96k tempo -25") << 96000 << -25 << 0 << 0 << (int)Resampler::Export
+                                          << 4.0 << SineFrequency;
+}
+
+/**
+ * The output of a sine must last the expected duration and keep
+ * its energy around the expected frequency
+ */
+void TestAudioPipeline::sine()
+{
+    QFETCH(int, inputRate);
+    QFETCH(int, tempo);
+    QFETCH(int, pitch);
+    QFETCH(int, outputRate);
+    QFETCH(int, quality);
+    QFETCH(double, duration);
+    QFETCH(double, frequency);
+
+    AudioEngine engine;
+    QString output = path(QString("sine_%1_%2_%3_%4.wav").arg(inputRate).arg(tempo).arg(pitch).arg(outputRate));
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY2(engine.render(path(QString("sine_%1.wav").arg(inputRate)), output, tempo, pitch, outputRate, (Resampler::Quality)quality),
+             qPrintable(engine.errorString()));
+    qint64 elapsed = timer.elapsed();
+
+    WavFormat format;
+    std::vector<float> samples = read_wav(output, format);
+    QCOMPARE(format.channels, (quint16)2);
+    QCOMPARE(format.sampleRate, (quint32)(outputRate ? outputRate : inputRate));
+    QVERIFY(format.isFloat);
+
+    double seconds = (double)samples.size() / format.channels / format.sampleRate;
+    QVERIFY2(std::abs(seconds - duration) <= 0.1 + 0.01 * duration,
+             qPrintable(QString("duration %1 s, expected %2 s").arg(seconds).arg(duration)));
+
+    std::vector<float> left = channel(samples, 2, 0);
+    std::vector<double> power = spectrum(left, left.size() / 2, 16384);
+    double measured = peak_frequency(power, format.sampleRate);
+    QVERIFY2(std::abs(measured - frequency) <= 0.01 * frequency,
+             qPrintable(QString("frequency %1 Hz, expected %2 Hz").arg(measured).arg(frequency)));
+    double ratio = power_ratio(power, format.sampleRate, frequency, 0.03);
+    QVERIFY2(ratio >= 0.8, qPrintable(QString("only %1 of the power around the sine").arg(ratio)));
+
+    // Latency budget : the slider of the player waits for this render
+    QString message = QString("render took %1 ms, budget 500 ms").arg(elapsed);
+    QVERIFY2(within_budget(elapsed, 500), qPrintable(message));
+}
+
+/**
+ * Tempo settings for the position mapping of the player
+ */
+void TestAudioPipeline::chirp_data()
+{
+    QTest::addColumn<int>("tempo");
+    QTest::addColumn<int>("pitch");
+
+    const int tempos[] = {-50, -25, 0, 50, 100, 200};
+    for (int tempo : tempos){
+        QTest::addRow("tempo %d", tempo) << tempo << 0;
+    }
+    QTest::newRow("tempo 50 pitch 5") << 50 << 5;
+    QTest::newRow("tempo -25 pitch -7") << -25 << -7;
+}
+
+/**
+ * The frequency of the chirp gives the time of the fixture played at each
+ * position of the output : it must match the position given by
+ * AudioEngine::mapPosition, which is used by the player after an effect change
+ */
+void TestAudioPipeline::chirp()
+{
+    QFETCH(int, tempo);
+    QFETCH(int, pitch);
+
+    AudioEngine engine;
+    QString output = path(QString("chirp_%1_%2.wav").arg(tempo).arg(pitch));
+    QVERIFY2(engine.render(path("chirp.wav"), output, tempo, pitch), qPrintable(engine.errorString()));
+    WavFormat format;
+    std::vector<float> samples = read_wav(output, format);
+    QCOMPARE(format.channels, (quint16)1);
+
+    double duration = ChirpSeconds * 100.0 / (tempo + 100);
+    double seconds = (double)samples.size() / format.sampleRate;
+    QVERIFY2(std::abs(seconds - duration) <= 0.1 + 0.01 * duration,
+             qPrintable(QString("duration %1 s, expected %2 s").arg(seconds).arg(duration)));
+
+    const double k = std::log(ChirpEnd / ChirpStart) / ChirpSeconds;
+    for (double source = 0.5; source < ChirpSeconds; source += 0.5){
+        double position = AudioEngine::mapPosition(source, 0, tempo);
+        std::vector<double> power = spectrum(samples, (qint64)(position * format.sampleRate), 2048);
+        double frequency = peak_frequency(power, format.sampleRate) / std::pow(2.0, pitch / 12.0);
+        double played = std::log(frequency / ChirpStart) / k;
+        // The stretching moves the audio by less than one of its sequences
+        QVERIFY2(std::abs(played - source) <= 0.08,
+                 qPrintable(QString("at %1 s, playing %2 s of the fixture instead of %3 s")
+                            .arg(position).arg(played).arg(source)));
+    }
+}
+
+/**
+ * Positions of the player (in seconds) before and after a tempo change
+ */
+void TestAudioPipeline::previewSeek_data()
+{
+    QTest::addColumn<int>("position");
+    QTest::addColumn<int>("fromTempo");
+    QTest::addColumn<int>("toTempo");
+    QTest::addColumn<int>("expected");
+
+    QTest::newRow("start") << 0 << 0 << 200 << 1;
+    QTest::newRow("same tempo") << 10 << 0 << 0 << 11;
+    QTest::newRow("double speed") << 10 << 0 << 100 << 6;
+    QTest::newRow("double speed truncated") << 7 << 0 << 100 << 4;
+    QTest::newRow("half speed") << 10 << 0 << -50 << 21;
+    QTest::newRow("back to normal") << 6 << 100 << 0 << 13;
+    QTest::newRow("150 to 75 percent") << 9 << 50 << -25 << 19;
+}
+
+/**
+ * After an effect change, the player starts the new audio just after
+ * the position it had in the previous one, and keeps the new tempo
+ */
+void TestAudioPipeline::previewSeek()
+{
+    QFETCH(int, position);
+    QFETCH(int, fromTempo);
+    QFETCH(int, toTempo);
+    QFETCH(int, expected);
+
+    PreviewFile preview(path("seek.wav"));
+    QCOMPARE(preview.tempo(), 0);
+    preview.setTempo(fromTempo);
+    QCOMPARE(preview.changeTempo(position, toTempo), expected);
+    QCOMPARE(preview.tempo(), toTempo);
+}
+
+/**
+ * The renders replace the played file only when they are complete,
+ * and no temporary file is left behind
+ */
+void TestAudioPipeline::previewReplace()
+{
+    auto write = [](const QString &name, const QByteArray &data){
+        QFile file(name);
+        return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+    };
+    auto read = [](const QString &name){
+        QFile file(name);
+        return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    };
+
+    QString played = path("preview.wav");
+    QString unfinished;
+    {
+        PreviewFile preview(played);
+        QCOMPARE(preview.path(), played);
+        QString first = preview.newRender();
+        QString second = preview.newRender();
+        QVERIFY(first != second && first != played && second != played);
+
+        QVERIFY(write(first, "first"));
+        QVERIFY(write(second, "second"));
+        QVERIFY(preview.replace(first));
+        QVERIFY(!QFile::exists(first));
+        QCOMPARE(read(played), QByteArray("first"));
+
+        // A newer render replaces the played file
+        QVERIFY(preview.replace(second));
+        QVERIFY(!QFile::exists(second));
+        QCOMPARE(read(played), QByteArray("second"));
+
+        // A discarded render is removed, a render never written keeps the played file
+        QString discarded = preview.newRender();
+        QVERIFY(write(discarded, "discarded"));
+        preview.discard(discarded);
+        QVERIFY(!QFile::exists(discarded));
+        QVERIFY(!preview.replace(preview.newRender()));
+        QCOMPARE(read(played), QByteArray("second"));
+
+        unfinished = preview.newRender();
+        QVERIFY(write(unfinished, "unfinished"));
+    }
+    QVERIFY(!QFile::exists(played));
+    QVERIFY(!QFile::exists(unfinished));
+}
+
+/**
+ * Rate conversions of the device, the clicks must stay at their place
+ */
+void TestAudioPipeline::clicks_data()
+{
+    QTest::addColumn<int>("outputRate");
+    QTest::addColumn<int>("quality");
+
+    QTest::newRow("no conversion") << 0 << (int)Resampler::Export;
+    QTest::newRow("preview 48k") << 48000 << (int)Resampler::Preview;
+    QTest::newRow("export 48k") << 48000 << (int)Resampler::Export;
+    QTest::newRow("export 22.05k") << 22050 << (int)Resampler::Export;
+    QTest::newRow("export 96k") << 96000 << (int)Resampler::Export;
+    QTest::newRow("export 44.101k") << 44101 << (int)Resampler::Export;
+}
+
+/**
+ * Without effect, the output must have exactly the length of the fixture
+ * and each click must be at its position, to one frame
+ */
+void TestAudioPipeline::clicks()
+{
+    QFETCH(int, outputRate);
+    QFETCH(int, quality);
+
+    AudioEngine engine;
+    QString output = path(QString("clicks_%1_%2.wav").arg(outputRate).arg(quality));
+    QVERIFY2(engine.render(path("clicks.wav"), output, 0, 0, outputRate, (Resampler::Quality)quality),
+             qPrintable(engine.errorString()));
+    WavFormat format;
+    std::vector<float> samples = read_wav(output, format);
+    const quint32 rate = outputRate ? outputRate : 44100;
+    QCOMPARE(format.sampleRate, rate);
+
+    qint64 input_frames = (qint64)(ClickSeconds * 44100);
+    qint64 expected_frames = (input_frames * rate + 44100 - 1) / 44100;
+    QCOMPARE((qint64)samples.size() / 2, expected_frames);
+
+    std::vector<qint64> found = find_clicks(channel(samples, 2, 0), rate, 0.2f);
+    std::vector<qint64> expected;
+    for (double t = ClickStart; t < ClickSeconds; t += ClickPeriod){
+        expected.push_back((qint64)std::llround(std::llround(t * 44100) * (double)rate / 44100));
+    }
+    QCOMPARE(found.size(), expected.size());
+    for (size_t i = 0; i < found.size(); i++){
+        QVERIFY2(std::abs(found[i] - expected[i]) <= 1,
+                 qPrintable(QString("click %1 at frame %2, expected %3").arg(i).arg(found[i]).arg(expected[i])));
+    }
+}
+
+/**
+ * 8 channels at 96 kHz in 24 bit : without effect the samples must be kept
+ * exactly (float output), with effects each channel must keep its own sine
+ * and the render must be faster than realtime
+ */
+void TestAudioPipeline::highResolution()
+{
+    const int channels = 8;
+    const quint32 rate = 96000;
+    const double seconds = 2.0;
+    WavFormat input_format = make_format(channels, rate, 24, false);
+    write_wav(path("sines_8ch.wav"), input_format, make_sines(channels, rate, seconds, 500.0, 0.1));
+    WavFormat format;
+    std::vector<float> input = read_wav(path("sines_8ch.wav"), format);
+    QCOMPARE(format.bitsPerSample, (quint16)24);
+    QCOMPARE(format.channelMask, WavFormat::defaultChannelMask(channels));
+
+    AudioEngine engine;
+    QVERIFY2(engine.render(path("sines_8ch.wav"), path("copy_8ch.wav"), 0, 0), qPrintable(engine.errorString()));
+    std::vector<float> copy = read_wav(path("copy_8ch.wav"), format);
+    QCOMPARE(format.bitsPerSample, (quint16)32);
+    QVERIFY(format.isFloat);
+    QCOMPARE(format.channelMask, WavFormat::defaultChannelMask(channels));
+    QCOMPARE(copy.size(), input.size());
+    QVERIFY(copy == input);
+
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY2(engine.render(path("sines_8ch.wav"), path("effect_8ch.wav"), 25, 2), qPrintable(engine.errorString()));
+    qint64 elapsed = timer.elapsed();
+    QString message = QString("render took %1 ms for %2 s of audio").arg(elapsed).arg(seconds);
+    QVERIFY2(within_budget(elapsed, seconds * 1000), qPrintable(message));
+
+    std::vector<float> effect = read_wav(path("effect_8ch.wav"), format);
+    QCOMPARE(format.channels, (quint16)channels);
+    for (int c = 0; c < channels; c++){
+        std::vector<float> samples = channel(effect, channels, c);
+        double expected = 500.0 * (c + 1) * std::pow(2.0, 2 / 12.0);
+        double measured = peak_frequency(spectrum(samples, samples.size() / 2, 16384), rate);
+        QVERIFY2(std::abs(measured - expected) <= 0.01 * expected,
+                 qPrintable(QString("channel %1 at %2 Hz, expected %3 Hz").arg(c).arg(measured).arg(expected)));
+    }
+}
+
+/**
+ * A file shortened while it is read is reported as an error, not as
+ * the end of a shorter file (the engine then fails the render)
+ */
+void TestAudioPipeline::readError()
+{
+    const quint32 rate = 44100;
+    QString input = path("shortened.wav");
+    write_wav(input, make_format(2, rate, 16, false), make_sines(2, rate, 2.0, 440.0, 0.5));
+
+    WavReader reader(input);
+    QVERIFY2(reader.open(), qPrintable(reader.errorString()));
+    QFile file(input);
+    QVERIFY(file.resize(file.size() / 2));
+    std::vector<float> buffer((size_t)AudioEngine::BlockFrames * 2);
+    qint64 total = 0;
+    qint64 frames;
+    while ((frames = reader.read(buffer.data(), AudioEngine::BlockFrames)) > 0){
+        total += frames;
+    }
+    QVERIFY(total < reader.frameCount());
+    QVERIFY(!reader.atEnd());
+    QVERIFY(!reader.errorString().isEmpty());
+
+    // A complete read reaches the end
+    WavReader complete(path("sine_44100.wav"));
+    QVERIFY(complete.open());
+    while (complete.read(buffer.data(), AudioEngine::BlockFrames) > 0){
+    }
+    QVERIFY(complete.atEnd());
+}
+
+/**
+ * A render cancelled from another thread stops early and fails
+ */
+void TestAudioPipeline::cancel()
+{
+    const quint32 rate = 48000;
+    const double seconds = 60.0;
+    QString input = path("long.wav");
+    write_wav(input, make_format(2, rate, 16, false), make_sines(2, rate, seconds, 440.0, 0.5));
+
+    AudioEngine engine;
+    QFuture<bool> render = QtConcurrent::run([&engine, this, input](){
+        return engine.render(input, path("cancelled.wav"), 50, 3);
+    });
+    QThread::msleep(20);
+    QElapsedTimer timer;
+    timer.start();
+    engine.cancel();
+    render.waitForFinished();
+    QVERIFY(!render.result());
+    QVERIFY(!engine.errorString().isEmpty());
+    QVERIFY(!engine.loudness().valid);
+    // The render stops at its next block, far before the end of the file
+    QString message = QString("stopped after %1 ms").arg(timer.elapsed());
+    QVERIFY2(within_budget(timer.elapsed(), 500), qPrintable(message));
+
+    // A cancelled engine does not start new renders
+    QVERIFY(!engine.render(input, path("cancelled.wav"), 0, 0));
+}
+
+/**
+ * The loudness of a 1 kHz sine is known (BS.1770) and the normalized
+ * render must reach the target. The meter must cost less than 1 % of a core
+ */
+void TestAudioPipeline::loudness()
+{
+    const quint32 rate = 48000;
+    const double seconds = 10.0;
+    // Amplitude 0.1 on both channels : -20 LUFS, -20 dBTP
+    std::vector<float> sine = make_sines(2, rate, seconds, 1000.0, 0.1);
+    for (size_t i = 1; i < sine.size(); i += 2){
+        sine[i] = sine[i - 1];
+    }
+    write_wav(path("loudness.wav"), make_format(2, rate, 32, true), sine);
+
+    AudioEngine engine;
+    QVERIFY2(engine.render(path("loudness.wav"), path("measured.wav"), 0, 0), qPrintable(engine.errorString()));
+    LoudnessInfo info = engine.loudness();
+    QVERIFY(info.valid);
+    QVERIFY2(std::abs(info.integrated + 20.0) <= 0.1, qPrintable(QString("%1 LUFS").arg(info.integrated)));
+    QVERIFY2(std::abs(info.truePeak + 20.0) <= 0.2, qPrintable(QString("%1 dBTP").arg(info.truePeak)));
+
+    engine.setGain(info.gain());
+    QVERIFY2(engine.render(path("loudness.wav"), path("normalized.wav"), 0, 0), qPrintable(engine.errorString()));
+    WavFormat format;
+    std::vector<float> normalized = read_wav(path("normalized.wav"), format);
+    LoudnessMeter meter(2, rate, 0x3);
+    meter.process(normalized.data(), normalized.size() / 2);
+    QVERIFY2(std::abs(meter.result().integrated + 18.0) <= 0.1,
+             qPrintable(QString("normalized to %1 LUFS").arg(meter.result().integrated)));
+
+    LoudnessMeter timed(2, rate, 0x3);
+    QElapsedTimer timer;
+    timer.start();
+    for (size_t i = 0; i < sine.size() / 2; i += AudioEngine::BlockFrames){
+        timed.process(&sine[i * 2], qMin<qint64>(AudioEngine::BlockFrames, sine.size() / 2 - i));
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+    QString message = QString("meter took %1 ms for %2 s of audio").arg(elapsed / 1e6).arg(seconds);
+    QVERIFY2(within_budget(elapsed, seconds * 1e9 * 0.01), qPrintable(message));
+}
+
+/**
+ * Long renders with the minimum speed expected, in times realtime
+ */
+void TestAudioPipeline::throughput_data()
+{
+    QTest::addColumn<int>("channels");
+    QTest::addColumn<int>("inputRate");
+    QTest::addColumn<int>("outputRate");
+    QTest::addColumn<int>("tempo");
+    QTest::addColumn<int>("pitch");
+    QTest::addColumn<double>("realtime");
+
+    QTest::newRow("stereo 44.1k effects") << 2 << 44100 << 0 << 50 << 3 << 10.0;
+    QTest::newRow("stereo 44.1k to 48k") << 2 << 44100 << 48000 << 0 << 0 << 20.0;
+    QTest::newRow("stereo 44.1k effects to 48k") << 2 << 44100 << 48000 << -25 << -4 << 8.0;
+    QTest::newRow("3 channels 48k effects") << 3 << 48000 << 0 << 25 << 2 << 4.0;
+    QTest::newRow("8 channels 96k effects") << 8 << 96000 << 0 << 25 << 2 << 1.0;
+}
+
+void TestAudioPipeline::throughput()
+{
+    QFETCH(int, channels);
+    QFETCH(int, inputRate);
+    QFETCH(int, outputRate);
+    QFETCH(int, tempo);
+    QFETCH(int, pitch);
+    QFETCH(double, realtime);
+
+    const double seconds = 10.0;
+    QString input = path(QString("noise_%1_%2.wav").arg(channels).arg(inputRate));
+    if (!QFile::exists(input)){
+        std::vector<float> noise((size_t)(seconds * inputRate) * channels);
+        quint32 seed = 1;
+        for (float &sample : noise){
+            seed = seed * 1664525u + 1013904223u;
+            sample = ((float)(seed >> 8) / 8388608.0f - 1.0f) * 0.25f;
+        }
+        write_wav(input, make_format(channels, inputRate, 16, false), noise);
+    }
+
+    AudioEngine engine;
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY2(engine.render(input, path("throughput.wav"), tempo, pitch, outputRate), qPrintable(engine.errorString()));
+    double elapsed = qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9;
+    QTest::setBenchmarkResult(elapsed * 1000, QTest::WalltimeMilliseconds);
+    QString message = QString("%1 x realtime, expected %2").arg(seconds / elapsed).arg(realtime);
+    QVERIFY2(within_budget(elapsed, seconds / realtime), qPrintable(message));
+}
+
+/**
+ * Headers of the files probed at import
+ */
+void TestAudioPipeline::probe_data()
+{
+    QTest::addColumn<QByteArray>("bytes");
+    QTest::addColumn<QString>("format");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<bool>("effects");
+
+    // ID3v2 tag of 20 bytes (size in 7 bit bytes) followed or not by an MPEG frame
+    QByteArray id3("ID3\x03\x00\x00\x00\x00\x00\x14", 10);
+    id3.append(20, '\0');
+    QByteArray frame("\xFF\xFB\x90\x00", 4);
+
+    QTest::newRow("pcm 16 bit wav") << riff_wav(1, 16, 2, 16) << "wav" << true << true;
+    QTest::newRow("adpcm wav") << riff_wav(2, 4, 256, 256) << "wav" << true << false;
+    QTest::newRow("a-law wav") << riff_wav(6, 8, 1, 16) << "wav" << true << false;
+    QTest::newRow("12 bit pcm wav") << riff_wav(1, 12, 2, 16) << "wav" << true << false;
+    QTest::newRow("mp3 with id3") << id3 + frame << "mp3" << true << false;
+    QTest::newRow("id3 without mp3") << id3 + QByteArray(4, 'x') << "" << false << false;
+    QTest::newRow("mp3 frame") << frame + QByteArray(8, '\0') << "mp3" << true << false;
+    QTest::newRow("ogg") << QByteArray("OggS").append(20, '\0') << "ogg" << true << false;
+    QTest::newRow("empty") << QByteArray() << "" << false << false;
+    QTest::newRow("text") << QByteArray("not an audio file") << "" << false << false;
+}
+
+/**
+ * The probe recognizes the format from the header : every WAV file can be
+ * played but only the encodings read by the engine get the effects
+ */
+void TestAudioPipeline::probe()
+{
+    QFETCH(QByteArray, bytes);
+    QFETCH(QString, format);
+    QFETCH(bool, valid);
+    QFETCH(bool, effects);
+
+    QString file = path("probe.bin");
+    QVERIFY(write_bytes(file, bytes));
+    ImportResult result = AudioImporter::probe(file);
+    QCOMPARE(result.path, file);
+    QCOMPARE(result.format, format);
+    QCOMPARE(result.valid, valid);
+    QCOMPARE(result.effects, effects);
+    QCOMPARE(result.error.isEmpty(), valid && (effects || format != "wav"));
+}
+
+/**
+ * An unreadable file of a folder is imported and flagged, not skipped
+ */
+void TestAudioPipeline::importUnreadable()
+{
+    QString folder = path("unreadable");
+    QVERIFY(QDir().mkpath(folder));
+    QString file = folder + "/locked.wav";
+    QVERIFY(write_bytes(file, riff_wav(1, 16, 2, 16)));
+    QVERIFY(QFile::setPermissions(file, QFileDevice::WriteOwner));
+    QFile check(file);
+    if (check.open(QIODevice::ReadOnly)){
+        QSKIP("The file is still readable with the rights of the test");
+    }
+
+    QStringList files = AudioImporter::expand(QStringList(folder));
+    QCOMPARE(files, QStringList(file));
+    ImportResult result = AudioImporter::probe(file);
+    QVERIFY(!result.valid);
+    QVERIFY(!result.error.isEmpty());
+}
+
+/**
+ * The batches of an import arrive in the sorted order of the folder walk,
+ * whatever the order in which the probes finish
+ */
+void TestAudioPipeline::importOrder()
+{
+    QString folder = path("order");
+    QVERIFY(QDir().mkpath(folder + "/sub"));
+    QByteArray wav = riff_wav(1, 16, 2, 16);
+    QVERIFY(write_bytes(folder + "/sub/inner.wav", wav));
+    // Created in reverse order, with a few files rejected by the probe
+    for (int i = 199; i >= 0; i--){
+        QVERIFY(write_bytes(folder + QString("/track%1.wav").arg(i, 3, 10, QChar('0')),
+                            i % 7 == 0 ? QByteArray("broken") : wav));
+    }
+    QStringList expected = AudioImporter::expand(QStringList(folder));
+    QCOMPARE(expected.size(), 201);
+
+    AudioImporter importer;
+    QStringList imported;
+    connect(&importer, &AudioImporter::batchReady, this, [&imported](const QList<ImportResult> &batch){
+        foreach (ImportResult result, batch){
+            imported << result.path;
+        }
+    });
+    QSignalSpy finished(&importer, &AudioImporter::finished);
+    importer.import(QStringList(folder));
+    QVERIFY(importer.isRunning());
+    QVERIFY(finished.wait(10000));
+    QVERIFY(!importer.isRunning());
+    QCOMPARE(imported, expected);
+}
+
+QTEST_GUILESS_MAIN(TestAudioPipeline)
+
+#include "tst_audiopipeline.moc"
@@ -0,0 +1,450 @@
+#include "wavfile.h"
+
+#include <QtEndian>
+#include <cstring>
+
+/**
+ * Load and store little endian IEEE floats
+ */
+static inline float load_float(const uchar *in)
+{
+    quint32 bits = qFromLittleEndian<quint32>(in);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline double load_double(const uchar *in)
+{
+    quint64 bits = qFromLittleEndian<quint64>(in);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline void store_float(float value, uchar *out)
+{
+    quint32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    qToLittleEndian<quint32>(bits, out);
+}
+
+static inline void store_double(double value, uchar *out)
+{
+    quint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    qToLittleEndian<quint64>(bits, out);
+}
+
+// The sample loops below walk the interleaved samples of every channel
+// at once, so their cost only depends on the number of samples and the
+// compiler can vectorize them whatever the number of channels
+
+/**
+ * Convert count raw samples of the given format to floats
+ */
+static void to_float(const uchar *in, float *out, qint64 count, const WavFormat &format)
+{
+    if (format.isFloat && format.bitsPerSample == 32){
+        for (qint64 i = 0; i < count; i++){
+            out[i] = load_float(in + 4*i);
+        }
+    }
+    else if (format.isFloat){
+        for (qint64 i = 0; i < count; i++){
+            out[i] = (float)load_double(in + 8*i);
+        }
+    }
+    else if (format.bitsPerSample == 8){
+        // 8 bit samples are the only unsigned ones
+        for (qint64 i = 0; i < count; i++){
+            out[i] = (float)(in[i] - 128) * (1.0f / 128.0f);
+        }
+    }
+    else if (format.bitsPerSample == 16){
+        for (qint64 i = 0; i < count; i++){
+            out[i] = (float)qFromLittleEndian<qint16>(in + 2*i) * (1.0f / 32768.0f);
+        }
+    }
+    else if (format.bitsPerSample == 24){
+        for (qint64 i = 0; i < count; i++){
+            const uchar *s = in + 3*i;
+            // The sample is put in the high bytes to keep its sign
+            qint32 value = (qint32)((quint32)s[0] << 8 | (quint32)s[1] << 16 | (quint32)s[2] << 24);
+            out[i] = (float)(value >> 8) * (1.0f / 8388608.0f);
+        }
+    }
+    else{
+        for (qint64 i = 0; i < count; i++){
+            out[i] = (float)qFromLittleEndian<qint32>(in + 4*i) * (1.0f / 2147483648.0f);
+        }
+    }
+}
+
+/**
+ * Returns the sample clamped to [-1, 1] and scaled to an integer of the given range
+ */
+static inline qint32 to_int(float sample, float scale, float max)
+{
+    float value = sample * scale;
+    value = value < -scale ? -scale : (value > max ? max : value);
+    return (qint32)(value >= 0.0f ? value + 0.5f : value - 0.5f);
+}
+
+/**
+ * Convert count floats to raw samples of the given format
+ */
+static void from_float(const float *in, uchar *out, qint64 count, const WavFormat &format)
+{
+    if (format.isFloat && format.bitsPerSample == 32){
+        for (qint64 i = 0; i < count; i++){
+            store_float(in[i], out + 4*i);
+        }
+    }
+    else if (format.isFloat){
+        for (qint64 i = 0; i < count; i++){
+            store_double(in[i], out + 8*i);
+        }
+    }
+    else if (format.bitsPerSample == 8){
+        for (qint64 i = 0; i < count; i++){
+            out[i] = (uchar)(to_int(in[i], 128.0f, 127.0f) + 128);
+        }
+    }
+    else if (format.bitsPerSample == 16){
+        for (qint64 i = 0; i < count; i++){
+            qToLittleEndian<qint16>((qint16)to_int(in[i], 32768.0f, 32767.0f), out + 2*i);
+        }
+    }
+    else if (format.bitsPerSample == 24){
+        for (qint64 i = 0; i < count; i++){
+            qint32 value = to_int(in[i], 8388608.0f, 8388607.0f);
+            out[3*i] = (uchar)value;
+            out[3*i + 1] = (uchar)(value >> 8);
+            out[3*i + 2] = (uchar)(value >> 16);
+        }
+    }
+    else{
+        for (qint64 i = 0; i < count; i++){
+            // 2^31 - 1 is not representable as a float, the largest float below it is used
+            qToLittleEndian<qint32>(to_int(in[i], 2147483648.0f, 2147483520.0f), out + 4*i);
+        }
+    }
+}
+
+//Wav reader constructor, the file is opened by open()
+WavReader::WavReader(const QString &path)
+    : file(path)
+{
+}
+
+/**
+ * Open the file and read its header
+ * Returns false if the file is not a supported WAV file (see errorString)
+ */
+bool WavReader::open()
+{
+    if (!file.open(QIODevice::ReadOnly)){
+        error = file.errorString();
+        return false;
+    }
+    QByteArray header = file.read(12);
+    if (header.size() < 12 || !header.startsWith("RIFF") || header.mid(8, 4) != "WAVE"){
+        error = "Not a RIFF/WAVE file";
+        return false;
+    }
+
+    bool fmt_found = false;
+    while (file.bytesAvailable() >= 8){
+        QByteArray chunk = file.read(8);
+        QByteArray id = chunk.left(4);
+        quint32 size = qFromLittleEndian<quint32>(chunk.constData() + 4);
+
+        if (id == "fmt "){
+            QByteArray fmt = file.read(qMin<quint32>(size, 40));
+            if (size < 16 || fmt.size() < 16){
+                error = "Invalid WAV format chunk";
+                return false;
+            }
+            const char *data = fmt.constData();
+            quint16 tag = qFromLittleEndian<quint16>(data);
+            wav_format.channels = qFromLittleEndian<quint16>(data + 2);
+            wav_format.sampleRate = qFromLittleEndian<quint32>(data + 4);
+            quint16 block_align = qFromLittleEndian<quint16>(data + 12);
+            wav_format.bitsPerSample = qFromLittleEndian<quint16>(data + 14);
+            wav_format.channelMask = 0;
+
+            // WAVE_FORMAT_EXTENSIBLE stores the real format in the first bytes of its sub-format
+            if (tag == 0xFFFE){
+                if (fmt.size() < 40){
+                    error = "Invalid WAV extensible format chunk";
+                    return false;
+                }
+                wav_format.channelMask = qFromLittleEndian<quint32>(data + 20);
+                tag = qFromLittleEndian<quint16>(data + 24);
+            }
+            // 1 : PCM, 3 : IEEE float
+            if (tag != 1 && tag != 3){
+                error = "Unsupported WAV encoding (compressed)";
+                return false;
+            }
+            wav_format.isFloat = (tag == 3);
+
+            bool valid_bits = wav_format.isFloat
+                    ? (wav_format.bitsPerSample == 32 || wav_format.bitsPerSample == 64)
+                    : (wav_format.bitsPerSample == 8 || wav_format.bitsPerSample == 16
+                       || wav_format.bitsPerSample == 24 || wav_format.bitsPerSample == 32);
+            if (!valid_bits){
+                error = "Unsupported WAV sample size : " + QString::number(wav_format.bitsPerSample) + " bits";
+                return false;
+            }
+            if (wav_format.channels == 0 || wav_format.sampleRate == 0
+                    || block_align != wav_format.bytesPerFrame()){
+                error = "Invalid WAV format chunk";
+                return false;
+            }
+            fmt_found = true;
+            size -= fmt.size();
+        }
+        else if (id == "data"){
+            if (!fmt_found){
+                error = "WAV data found before its format";
+                return false;
+            }
+            data_start = file.pos();
+            // Some writers leave the size empty or too big when they are interrupted
+            qint64 data_size = file.size() - data_start;
+            if (size != 0){
+                data_size = qMin<qint64>(size, data_size);
+            }
+            data_frames = data_size / wav_format.bytesPerFrame();
+            frames_read = 0;
+            return true;
+        }
+        // Chunks are padded to an even size
+        if (!file.seek(file.pos() + size + (size & 1))){
+            break;
+        }
+    }
+    error = "WAV file without audio data";
+    return false;
+}
+
+/**
+ * Returns the reason of the last failure
+ */
+QString WavReader::errorString() const
+{
+    return error;
+}
+
+/**
+ * Returns the format of the samples in the file
+ */
+const WavFormat &WavReader::format() const
+{
+    return wav_format;
+}
+
+/**
+ * Returns the number of frames in the file
+ */
+qint64 WavReader::frameCount() const
+{
+    return data_frames;
+}
+
+/**
+ * Read at most frames frames into buffer (frames * channels floats)
+ * Returns the number of frames read, 0 at the end of the file
+ */
+qint64 WavReader::read(float *buffer, qint64 frames)
+{
+    frames = qMin(frames, data_frames - frames_read);
+    if (frames <= 0){
+        return 0;
+    }
+    qint64 bytes = frames * wav_format.bytesPerFrame();
+    if (raw.size() < bytes){
+        raw.resize(bytes);
+    }
+    qint64 got = file.read(raw.data(), bytes);
+    if (got < 0){
+        error = file.errorString();
+        read_failed = true;
+        return 0;
+    }
+    if (got < bytes){
+        // The file was shortened after being opened
+        error = "Unexpected end of the WAV data";
+        read_failed = true;
+    }
+    frames = got / wav_format.bytesPerFrame();
+    to_float(reinterpret_cast<const uchar*>(raw.constData()), buffer,
+             frames * wav_format.channels, wav_format);
+    frames_read += frames;
+    return frames;
+}
+
+/**
+ * Move the reading position to the given frame
+ */
+bool WavReader::seekFrame(qint64 frame)
+{
+    if (frame < 0 || frame > data_frames){
+        return false;
+    }
+    if (!file.seek(data_start + frame * wav_format.bytesPerFrame())){
+        error = file.errorString();
+        return false;
+    }
+    frames_read = frame;
+    return true;
+}
+
+/**
+ * Returns true if every frame of the data chunk was read
+ * (read also returns 0 after an error, see errorString)
+ */
+bool WavReader::atEnd() const
+{
+    return !read_failed && frames_read >= data_frames;
+}
+
+/**
+ * Returns the usual speaker positions for the number of channels
+ * (mono, stereo, 2.1, quad, 5.0, 5.1, 6.1, 7.1), 0 above 8 channels
+ */
+quint32 WavFormat::defaultChannelMask(int channels)
+{
+    static const quint32 masks[] = {0x4, 0x3, 0x7, 0x33, 0x37, 0x3F, 0x13F, 0x63F};
+    return (channels >= 1 && channels <= 8) ? masks[channels - 1] : 0;
+}
+
+//Wav writer constructor, the file is created by open()
+WavWriter::WavWriter(const QString &path, const WavFormat &format)
+    : file(path)
+    , wav_format(format)
+{
+}
+
+//Wav writer destructor, closes the file if it is still open
+WavWriter::~WavWriter()
+{
+    if (file.isOpen()){
+        close();
+    }
+}
+
+/**
+ * Create the file and write its header
+ */
+bool WavWriter::open()
+{
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)){
+        error = file.errorString();
+        return false;
+    }
+    bool extensible = wav_format.channels > 2 || wav_format.bitsPerSample > 16;
+    quint16 tag = wav_format.isFloat ? 3 : 1;
+
+    QByteArray fmt(extensible ? 40 : (wav_format.isFloat ? 18 : 16), 0);
+    char *data = fmt.data();
+    qToLittleEndian<quint16>(extensible ? 0xFFFE : tag, data);
+    qToLittleEndian<quint16>(wav_format.channels, data + 2);
+    qToLittleEndian<quint32>(wav_format.sampleRate, data + 4);
+    qToLittleEndian<quint32>(wav_format.sampleRate * wav_format.bytesPerFrame(), data + 8);
+    qToLittleEndian<quint16>(wav_format.bytesPerFrame(), data + 12);
+    qToLittleEndian<quint16>(wav_format.bitsPerSample, data + 14);
+    if (extensible){
+        static const uchar guid_tail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+                                            0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+        quint32 mask = wav_format.channelMask ? wav_format.channelMask
+                                              : WavFormat::defaultChannelMask(wav_format.channels);
+        qToLittleEndian<quint16>(22, data + 16);
+        qToLittleEndian<quint16>(wav_format.bitsPerSample, data + 18);
+        qToLittleEndian<quint32>(mask, data + 20);
+        qToLittleEndian<quint16>(tag, data + 24);
+        memcpy(data + 26, guid_tail, sizeof(guid_tail));
+    }
+
+    QByteArray header;
+    header.append("RIFF").append(4, '\0').append("WAVE");
+    header.append("fmt ").append(4, '\0').append(fmt);
+    qToLittleEndian<quint32>(fmt.size(), header.data() + 16);
+    // The sizes of "RIFF", "fact" and "data" are written by close()
+    if (wav_format.isFloat){
+        header.append("fact").append(4, '\0').append(4, '\0');
+        qToLittleEndian<quint32>(4, header.data() + header.size() - 8);
+    }
+    header.append("data").append(4, '\0');
+    data_size_pos = header.size() - 4;
+    frames_written = 0;
+
+    if (file.write(header) != header.size()){
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Returns the reason of the last failure
+ */
+QString WavWriter::errorString() const
+{
+    return error;
+}
+
+/**
+ * Write frames frames from buffer (frames * channels floats)
+ * Fails without writing if the file would exceed the 4 GiB of the WAV sizes
+ */
+bool WavWriter::write(const float *buffer, qint64 frames)
+{
+    qint64 bytes = frames * wav_format.bytesPerFrame();
+    // The sizes of the header are 32 bit : the RIFF chunk (the header after
+    // its first 8 bytes, the data and its padding byte) cannot go above 4 GiB
+    const qint64 max_data = 0xFFFFFFFFLL - (data_size_pos + 4 - 8) - 1;
+    if (frames_written * wav_format.bytesPerFrame() + bytes > max_data){
+        error = "The WAV file would be larger than 4 GiB";
+        return false;
+    }
+    if (raw.size() < bytes){
+        raw.resize(bytes);
+    }
+    from_float(buffer, reinterpret_cast<uchar*>(raw.data()), frames * wav_format.channels, wav_format);
+    if (file.write(raw.constData(), bytes) != bytes){
+        error = file.errorString();
+        return false;
+    }
+    frames_written += frames;
+    return true;
+}
+
+/**
+ * Write the final sizes in the header and close the file
+ */
+bool WavWriter::close()
+{
+    qint64 data_size = frames_written * wav_format.bytesPerFrame();
+    bool ok = true;
+    // The data chunk is padded to an even size
+    if (data_size & 1){
+        ok = file.putChar(0);
+    }
+    uchar size[4];
+    qToLittleEndian<quint32>(file.size() - 8, size);
+    ok = ok && file.seek(4) && file.write(reinterpret_cast<char*>(size), 4) == 4;
+    if (wav_format.isFloat){
+        qToLittleEndian<quint32>(frames_written, size);
+        ok = ok && file.seek(data_size_pos - 8) && file.write(reinterpret_cast<char*>(size), 4) == 4;
+    }
+    qToLittleEndian<quint32>(data_size, size);
+    ok = ok && file.seek(data_size_pos) && file.write(reinterpret_cast<char*>(size), 4) == 4;
+    if (!ok){
+        error = file.errorString();
+    }
+    file.close();
+    return ok;
+}
@@ -0,0 +1,169 @@
+#ifndef WAVFILE_H
+#define WAVFILE_H
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+
+/**
+ * Format of the samples stored in a WAV file
+ */
+struct WavFormat
+{
+    //Number of interleaved channels
+    quint16 channels = 2;
+
+    //Number of frames (one sample per channel) per second
+    quint32 sampleRate = 44100;
+
+    //Size of one sample in bits (8, 16, 24 or 32 for PCM, 32 or 64 for float)
+    quint16 bitsPerSample = 32;
+
+    //Bool defining if the samples are IEEE float or integer PCM
+    bool isFloat = true;
+
+    //Speaker positions of the channels (WAVE_FORMAT_EXTENSIBLE), 0 if unknown
+    quint32 channelMask = 0;
+
+    //Size of one frame in bytes
+    int bytesPerFrame() const { return channels * (bitsPerSample / 8); }
+
+    /**
+     * Returns the usual speaker positions for the number of channels
+     * (mono, stereo, 2.1, quad, 5.0, 5.1, 6.1, 7.1), 0 above 8 channels
+     */
+    static quint32 defaultChannelMask(int channels);
+};
+
+/**
+ * Reads the samples of a PCM or IEEE float WAV file as interleaved floats.
+ * Any number of channels and any sample rate are accepted, the integer
+ * samples are scaled to [-1, 1] and the float samples are kept as they are.
+ */
+class WavReader
+{
+public:
+    //Wav reader constructor, the file is opened by open()
+    explicit WavReader(const QString &path);
+
+    /**
+     * Open the file and read its header
+     * Returns false if the file is not a supported WAV file (see errorString)
+     */
+    bool open();
+
+    /**
+     * Returns the reason of the last failure
+     */
+    QString errorString() const;
+
+    /**
+     * Returns the format of the samples in the file
+     */
+    const WavFormat &format() const;
+
+    /**
+     * Returns the number of frames in the file
+     */
+    qint64 frameCount() const;
+
+    /**
+     * Read at most frames frames into buffer (frames * channels floats)
+     * Returns the number of frames read, 0 at the end of the file
+     */
+    qint64 read(float *buffer, qint64 frames);
+
+    /**
+     * Move the reading position to the given frame
+     */
+    bool seekFrame(qint64 frame);
+
+    /**
+     * Returns true if every frame of the data chunk was read
+     * (read also returns 0 after an error, see errorString)
+     */
+    bool atEnd() const;
+
+private:
+    //The file read
+    QFile file;
+
+    //Format read in the "fmt " chunk
+    WavFormat wav_format;
+
+    //Position of the first sample in the file
+    qint64 data_start = 0;
+
+    //Number of frames in the "data" chunk
+    qint64 data_frames = 0;
+
+    //Number of frames already read
+    qint64 frames_read = 0;
+
+    //Bool defining if a read failed before the end of the data
+    bool read_failed = false;
+
+    //Raw bytes read from the file before the conversion
+    QByteArray raw;
+
+    //Reason of the last failure
+    QString error;
+};
+
+/**
+ * Writes interleaved floats in a WAV file.
+ * The samples are stored as 32 bit float by default so that
+ * the output of the effects is not requantized.
+ * WAVE_FORMAT_EXTENSIBLE is used for more than 2 channels or 16 bits.
+ */
+class WavWriter
+{
+public:
+    //Wav writer constructor, the file is created by open()
+    WavWriter(const QString &path, const WavFormat &format);
+
+    //Wav writer destructor, closes the file if it is still open
+    ~WavWriter();
+
+    /**
+     * Create the file and write its header
+     */
+    bool open();
+
+    /**
+     * Returns the reason of the last failure
+     */
+    QString errorString() const;
+
+    /**
+     * Write frames frames from buffer (frames * channels floats)
+     * Fails without writing if the file would exceed the 4 GiB of the WAV sizes
+     */
+    bool write(const float *buffer, qint64 frames);
+
+    /**
+     * Write the final sizes in the header and close the file
+     */
+    bool close();
+
+private:
+    //The file written
+    QFile file;
+
+    //Format of the samples in the file
+    WavFormat wav_format;
+
+    //Number of frames written
+    qint64 frames_written = 0;
+
+    //Position of the size of the "data" chunk in the file
+    qint64 data_size_pos = 0;
+
+    //Raw bytes converted before being written
+    QByteArray raw;
+
+    //Reason of the last failure
+    QString error;
+};
+
+#endif // WAVFILE_H